@@ -0,0 +1,321 @@
+#include "pch.h"
+#include "AssetLoader.h"
+
+#include <Kore/System.h>
+
+#include "ObjLoader.h"
+#include "MeshFile.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	// 0 for formats whose pixels cannot be copied one row at a time
+	int bytesPerPixel(const Kore::Graphics1::Image* image)
+	{
+		if (image->compression != Kore::Graphics1::ImageCompressionNone) return 0;
+		switch (image->format)
+		{
+		case Kore::Graphics1::Image::Grey8:
+			return 1;
+		case Kore::Graphics1::Image::A16:
+			return 2;
+		case Kore::Graphics1::Image::RGB24:
+			return 3;
+		case Kore::Graphics1::Image::RGBA32:
+		case Kore::Graphics1::Image::BGRA32:
+		case Kore::Graphics1::Image::A32:
+			return 4;
+		case Kore::Graphics1::Image::RGBA64:
+			return 8;
+		case Kore::Graphics1::Image::RGBA128:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// A scaled mesh has other vertices, so it is a different asset
+	std::string meshKey(const std::string& filename, float scale)
+	{
+		// Enough digits to tell every two floats apart
+		char scaleText[32];
+		snprintf(scaleText, sizeof(scaleText), "%.9g", scale);
+		return filename + "@" + scaleText;
+	}
+
+	std::string textureKey(const std::string& filename, bool readable)
+	{
+		return readable ? filename + "@readable" : filename;
+	}
+}
+
+AssetLoader::AssetLoader()
+:
+quit(false), pending(0)
+{
+	thread = std::thread(&AssetLoader::loaderLoop, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wakeUp.notify_all();
+	thread.join();
+
+	// Only requests that were released while they were loading are left. A request that is still
+	// referenced belongs to an object that outlives the loader, it is leaked instead of freed under it
+	for (std::map<std::string, MeshRequest*>::iterator it = meshes.begin(); it != meshes.end();)
+	{
+		MeshRequest* request = (it++)->second;
+		if (request->references == 0) destroy(request);
+	}
+	for (std::map<std::string, TextureRequest*>::iterator it = textures.begin(); it != textures.end();)
+	{
+		TextureRequest* request = (it++)->second;
+		if (request->references == 0) destroy(request);
+	}
+	assert(meshes.empty() && textures.empty());
+}
+
+MeshRequest* AssetLoader::loadMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale)
+{
+	MeshRequest*& request = meshes[meshKey(filename, scale)];
+	if (request != nullptr)
+	{
+		++request->references;
+		return request;
+	}
+
+	request = new MeshRequest;
+	request->filename = filename;
+	request->structure = structure;
+	request->scale = scale;
+	request->references = 1;
+	request->ready = false;
+	request->vertexBuffer = nullptr;
+	request->indexBuffer = nullptr;
+
+	Work work = { request, nullptr };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(work);
+	}
+	++pending;
+	wakeUp.notify_one();
+	return request;
+}
+
+TextureRequest* AssetLoader::loadTexture(const char* filename, bool readable)
+{
+	TextureRequest*& request = textures[textureKey(filename, readable)];
+	if (request != nullptr)
+	{
+		++request->references;
+		return request;
+	}
+
+	request = new TextureRequest;
+	request->filename = filename;
+	request->readable = readable;
+	request->references = 1;
+	request->image = nullptr;
+	request->ready = false;
+	request->texture = nullptr;
+
+	Work work = { nullptr, request };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(work);
+	}
+	++pending;
+	wakeUp.notify_one();
+	return request;
+}
+
+void AssetLoader::update(double budget)
+{
+	double start = Kore::System::time();
+	while (pending > 0)
+	{
+		Work work;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (loaded.empty()) return;
+			work = loaded.front();
+			loaded.pop_front();
+		}
+
+		upload(work);
+		--pending;
+
+		if (Kore::System::time() - start >= budget) return;
+	}
+}
+
+void AssetLoader::release(MeshRequest* request)
+{
+	// Assets that are still loading are dropped when they arrive in update
+	if (--request->references == 0 && request->ready) destroy(request);
+}
+
+void AssetLoader::release(TextureRequest* request)
+{
+	if (--request->references == 0 && request->ready) destroy(request);
+}
+
+void AssetLoader::destroy(MeshRequest* request)
+{
+	meshes.erase(meshKey(request->filename, request->scale));
+	delete request->vertexBuffer;
+	delete request->indexBuffer;
+	delete request;
+}
+
+void AssetLoader::destroy(TextureRequest* request)
+{
+	textures.erase(textureKey(request->filename, request->readable));
+	delete request->image;
+	delete request->texture;
+	delete request;
+}
+
+bool AssetLoader::isDone() const
+{
+	return pending == 0;
+}
+
+void AssetLoader::loaderLoop()
+{
+	for (;;)
+	{
+		Work work;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] { return quit || !queued.empty(); });
+			if (quit) return;
+			work = queued.front();
+			queued.pop_front();
+		}
+
+		load(work);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		loaded.push_back(work);
+	}
+}
+
+void AssetLoader::load(const Work& work)
+{
+	if (work.texture != nullptr)
+	{
+		// Decoding is the slow part, the upload only copies the pixels
+		work.texture->image = new Kore::Graphics1::Image(work.texture->filename.c_str(), true);
+		return;
+	}
+
+	MeshRequest* request = work.mesh;
+	const float scale = request->scale;
+
+	// Same as in MeshObject: the binary version if there is a current one, the .obj otherwise
+	MeshFile file;
+	if (file.openFor(request->filename.c_str()))
+	{
+		const float* vertices = file.getVertices();
+		request->vertices.assign(vertices, vertices + file.getNumVertices() * 8);
+		request->indices.assign(file.getIndices(), file.getIndices() + file.getNumIndices());
+		if (scale != 1.0f)
+		{
+			for (unsigned i = 0; i < request->vertices.size(); ++i)
+			{
+				if (i % 8 < 3) request->vertices[i] *= scale;
+			}
+		}
+		return;
+	}
+
+	Mesh* mesh = loadObjWelded(request->filename.c_str());
+	request->vertices.resize(mesh->numVertices * 8);
+	for (int i = 0; i < mesh->numVertices; ++i)
+	{
+		float* vertex = &request->vertices[i * 8];
+		const float* source = &mesh->vertices[i * 8];
+		vertex[0] = source[0] * scale;
+		vertex[1] = source[1] * scale;
+		vertex[2] = source[2] * scale;
+		vertex[3] = source[3];
+		vertex[4] = 1.0f - source[4];
+		vertex[5] = source[5];
+		vertex[6] = source[6];
+		vertex[7] = source[7];
+	}
+	request->indices.assign(mesh->indices, mesh->indices + mesh->numFaces * 3);
+}
+
+void AssetLoader::upload(const Work& work)
+{
+	if (work.texture != nullptr)
+	{
+		TextureRequest* request = work.texture;
+		if (request->references == 0)
+		{
+			destroy(request);
+			return;
+		}
+
+		Kore::Graphics1::Image* image = request->image;
+		const int pixelSize = bytesPerPixel(image);
+		Kore::Graphics4::Texture* texture;
+		if (pixelSize == 0)
+		{
+			// Compressed textures are uploaded in blocks, Kore knows how
+			texture = new Kore::Graphics4::Texture(request->filename.c_str(), request->readable);
+		}
+		else
+		{
+			texture = new Kore::Graphics4::Texture(image->width, image->height, image->format, request->readable);
+
+			// The rows of the texture can be longer than the rows of the image
+			const int rowSize = image->width * pixelSize;
+			Kore::u8* pixels = texture->lock();
+			const int stride = texture->stride();
+			for (int y = 0; y < image->height; ++y)
+			{
+				memcpy(&pixels[y * stride], &image->data[y * rowSize], rowSize);
+			}
+			texture->unlock();
+		}
+
+		delete image;
+		request->image = nullptr;
+		request->texture = texture;
+		request->ready = true;
+		return;
+	}
+
+	MeshRequest* request = work.mesh;
+	if (request->references == 0)
+	{
+		destroy(request);
+		return;
+	}
+
+	const int vertexCount = (int)request->vertices.size() / 8;
+	request->vertexBuffer = new Kore::Graphics4::VertexBuffer(vertexCount, request->structure, 0);
+	memcpy(request->vertexBuffer->lock(), request->vertices.data(), request->vertices.size() * sizeof(float));
+	request->vertexBuffer->unlock();
+
+	request->indexBuffer = new Kore::Graphics4::IndexBuffer((int)request->indices.size());
+	memcpy(request->indexBuffer->lock(), request->indices.data(), request->indices.size() * sizeof(int));
+	request->indexBuffer->unlock();
+
+	// The buffers have their own copy now
+	std::vector<float>().swap(request->vertices);
+	std::vector<int>().swap(request->indices);
+	request->ready = true;
+}
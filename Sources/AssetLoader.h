@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Graphics4/Graphics.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* A mesh requested from an AssetLoader. The buffers can be used once
+* ready is set.
+*/
+struct MeshRequest
+{
+	std::string filename;
+	Kore::Graphics4::VertexStructure structure;
+	float scale;
+
+	// The users that have not released the mesh yet, only used on the main thread
+	int references;
+
+	// Filled by the loader thread, in the layout of the vertex buffer
+	std::vector<float> vertices;
+	std::vector<int> indices;
+
+	// Set on the main thread when the buffers are uploaded
+	bool ready;
+	Kore::Graphics4::VertexBuffer* vertexBuffer;
+	Kore::Graphics4::IndexBuffer* indexBuffer;
+};
+
+/**
+* A texture requested from an AssetLoader. The texture can be used
+* once ready is set.
+*/
+struct TextureRequest
+{
+	std::string filename;
+	bool readable;
+
+	// The users that have not released the texture yet, only used on the main thread
+	int references;
+
+	// Decoded by the loader thread
+	Kore::Graphics1::Image* image;
+
+	// Set on the main thread when the texture is uploaded
+	bool ready;
+	Kore::Graphics4::Texture* texture;
+};
+
+/**
+* Loads meshes and textures in the background.
+*
+* A loader thread reads and decodes the requested files into memory.
+* The upload to the GPU has to happen on the main thread, update does
+* it within a time budget per frame, so the first frame can be shown
+* before everything is loaded.
+*
+* The loader is also the registry of the loaded assets. Requesting a
+* file again returns the same request, so every file is loaded and
+* uploaded once, and the users share the buffers and textures. Every
+* request has to be released once, the last release frees the asset.
+*/
+class AssetLoader
+{
+public:
+	AssetLoader();
+
+	/**
+	* Stops the loader thread. Every request has to be released
+	* before, so the objects that use the assets have to go first.
+	*/
+	~AssetLoader();
+
+	/**
+	* Queues a mesh, or returns the one that was requested with the
+	* same file and scale before. Prefers the binary .kmesh next to an
+	* .obj file, like the MeshObject constructor that loads right away.
+	*/
+	MeshRequest* loadMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f);
+
+	/**
+	* Queues a texture, or returns the one that was requested with the
+	* same file and readability before.
+	*/
+	TextureRequest* loadTexture(const char* filename, bool readable = false);
+
+	/**
+	* Gives up one reference to the asset. The last one deletes the
+	* buffers or the texture, or drops the asset when it is uploaded
+	* if it is still loading.
+	*/
+	void release(MeshRequest* request);
+	void release(TextureRequest* request);
+
+	/**
+	* Uploads loaded assets until budget seconds have passed, at least
+	* one per call. Call once per frame on the main thread.
+	*/
+	void update(double budget);
+
+	/**
+	* True when every requested asset is ready.
+	*/
+	bool isDone() const;
+
+private:
+	AssetLoader(const AssetLoader&);
+	AssetLoader& operator=(const AssetLoader&);
+
+	// One of the two is set
+	struct Work
+	{
+		MeshRequest* mesh;
+		TextureRequest* texture;
+	};
+
+	void loaderLoop();
+	void load(const Work& work);
+	void upload(const Work& work);
+	void destroy(MeshRequest* request);
+	void destroy(TextureRequest* request);
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool quit;
+
+	// Waiting for the loader thread
+	std::deque<Work> queued;
+
+	// Loaded, waiting for the upload
+	std::deque<Work> loaded;
+
+	// Requested but not uploaded yet, only used on the main thread
+	int pending;
+
+	// The registry, keyed by the file plus the settings that change what is uploaded
+	std::map<std::string, MeshRequest*> meshes;
+	std::map<std::string, TextureRequest*> textures;
+};
@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "BatchStateMachine.h"
+
+#include <assert.h>
+
+using namespace Kore;
+
+void DistanceBatchCondition::test(const unsigned* agents, unsigned count, unsigned char* results)
+{
+	const float distanceSquared = transitionDistance * transitionDistance;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned agent = agents[i];
+		vec2 offset = *first[agent] - *second[agent];
+		float squared = offset.x() * offset.x() + offset.y() * offset.y();
+		results[i] = (checkIfCloser ? squared < distanceSquared : squared >= distanceSquared) ? 1 : 0;
+	}
+}
+
+StateMachineDefinition::StateMachineDefinition()
+:
+initialState(0)
+{}
+
+unsigned StateMachineDefinition::addState()
+{
+	transitions.push_back(std::vector<TransitionDefinition>());
+	return transitions.size() - 1;
+}
+
+void StateMachineDefinition::addTransition(unsigned from, unsigned to, BatchCondition* condition)
+{
+	assert(from < transitions.size() && to < transitions.size());
+	TransitionDefinition transition;
+	transition.target = to;
+	transition.condition = condition;
+	transitions[from].push_back(transition);
+}
+
+StateMachineBatch::StateMachineBatch(const StateMachineDefinition* definition)
+:
+definition(definition)
+{}
+
+unsigned StateMachineBatch::addAgent()
+{
+	states.push_back((unsigned short)definition->initialState);
+	return states.size() - 1;
+}
+
+const std::vector<StateMachineBatch::StateChange>& StateMachineBatch::update()
+{
+	changes.clear();
+	
+	unsigned stateCount = definition->getStateCount();
+	unsigned agentCount = states.size();
+	
+	// Group the agents by state with a counting sort
+	stateStart.assign(stateCount + 1, 0);
+	for (unsigned agent = 0; agent < agentCount; ++agent)
+	{
+		stateStart[states[agent] + 1]++;
+	}
+	for (unsigned state = 0; state < stateCount; ++state)
+	{
+		stateStart[state + 1] += stateStart[state];
+	}
+	agentsByState.resize(agentCount);
+	groupCursor.assign(stateStart.begin(), stateStart.end() - 1);
+	for (unsigned agent = 0; agent < agentCount; ++agent)
+	{
+		agentsByState[groupCursor[states[agent]]++] = agent;
+	}
+	
+	results.resize(agentCount);
+	
+	for (unsigned state = 0; state < stateCount; ++state)
+	{
+		const std::vector<StateMachineDefinition::TransitionDefinition>& transitions = definition->getTransitions(state);
+		
+		// All agents of the state wait for a transition to trigger
+		waiting.assign(agentsByState.begin() + stateStart[state], agentsByState.begin() + stateStart[state + 1]);
+		
+		for (unsigned t = 0; t < transitions.size() && !waiting.empty(); ++t)
+		{
+			const StateMachineDefinition::TransitionDefinition& transition = transitions[t];
+			
+			// One tight loop over all agents that are still waiting
+			unsigned char* triggered = &results[0];
+			transition.condition->test(&waiting[0], waiting.size(), triggered);
+			
+			// Take the transition for the triggered agents, keep the others for the next transition
+			unsigned remaining = 0;
+			for (unsigned i = 0; i < waiting.size(); ++i)
+			{
+				unsigned agent = waiting[i];
+				if (triggered[i])
+				{
+					StateChange change;
+					change.agent = agent;
+					change.from = state;
+					change.to = transition.target;
+					changes.push_back(change);
+					states[agent] = (unsigned short)transition.target;
+				}
+				else
+				{
+					waiting[remaining++] = agent;
+				}
+			}
+			waiting.resize(remaining);
+		}
+	}
+	
+	return changes;
+}
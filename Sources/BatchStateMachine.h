@@ -0,0 +1,163 @@
+#pragma once
+
+#include <Kore/Math/Vector.h>
+
+#include <vector>
+
+/**
+* @file
+*
+* A state machine for many agents that share one machine
+* definition. The definition (states, transitions and conditions) is
+* immutable and shared, each agent only stores the index of its
+* current state. An update checks one transition for all agents in
+* its source state at once, so there is one virtual call per
+* transition instead of one per agent.
+*/
+
+/**
+* A condition that is tested for a whole group of agents at once.
+*/
+class BatchCondition
+{
+public:
+	/**
+	* Tests the condition for each of the count agents and writes
+	* the results into results, one per agent (1 if the condition
+	* holds, otherwise 0).
+	*/
+	virtual void test(const unsigned* agents, unsigned count, unsigned char* results) = 0;
+};
+
+/**
+* A condition that checks the distance between two points per agent,
+* for example between each agent and the thing it follows. Works like
+* the moon's condition in Exercise.cpp for many agents.
+*/
+class DistanceBatchCondition : public BatchCondition
+{
+public:
+	/**
+	* The two points of each agent, indexed by agent.
+	*/
+	std::vector<const Kore::vec2*> first;
+	std::vector<const Kore::vec2*> second;
+
+	float transitionDistance;
+
+	/**
+	* If set, the condition is true when the points are closer than
+	* transitionDistance, otherwise when they are at least that far
+	* apart.
+	*/
+	bool checkIfCloser;
+
+	virtual void test(const unsigned* agents, unsigned count, unsigned char* results);
+};
+
+/**
+* The shared, immutable part of a batched state machine. States are
+* numbered in the order in which they are added.
+*/
+class StateMachineDefinition
+{
+public:
+	struct TransitionDefinition
+	{
+		unsigned target;
+		BatchCondition* condition;
+	};
+
+	StateMachineDefinition();
+
+	/**
+	* Adds a state and returns its index.
+	*/
+	unsigned addState();
+
+	/**
+	* Adds a transition. Transitions leaving the same state are
+	* checked in the order in which they are added, the first one
+	* that triggers is taken.
+	*/
+	void addTransition(unsigned from, unsigned to, BatchCondition* condition);
+
+	unsigned getStateCount() const
+	{
+		return transitions.size();
+	}
+
+	const std::vector<TransitionDefinition>& getTransitions(unsigned state) const
+	{
+		return transitions[state];
+	}
+
+	/**
+	* The state new agents start in.
+	*/
+	unsigned initialState;
+
+private:
+	// The transitions leaving each state
+	std::vector< std::vector<TransitionDefinition> > transitions;
+};
+
+/**
+* The per-agent part of a batched state machine: one state index per
+* agent.
+*/
+class StateMachineBatch
+{
+public:
+	/**
+	* A transition taken by one agent during update.
+	*/
+	struct StateChange
+	{
+		unsigned agent;
+		unsigned from;
+		unsigned to;
+	};
+
+	explicit StateMachineBatch(const StateMachineDefinition* definition);
+
+	/**
+	* Adds an agent in the initial state and returns its index.
+	*/
+	unsigned addAgent();
+
+	unsigned getAgentCount() const
+	{
+		return states.size();
+	}
+
+	unsigned getState(unsigned agent) const
+	{
+		return states[agent];
+	}
+
+	/**
+	* Checks the transitions of all agents and applies them. Returns
+	* the state changes of this update, sorted by source state, so
+	* that the caller can run the matching actions per agent. The list
+	* is valid until the next update.
+	*/
+	const std::vector<StateChange>& update();
+
+private:
+	const StateMachineDefinition* definition;
+
+	// The state of each agent
+	std::vector<unsigned short> states;
+
+	// Agents grouped by state, the group of state s starts at stateStart[s]
+	std::vector<unsigned> agentsByState;
+	std::vector<unsigned> stateStart;
+
+	// Scratch lists for the grouping and the condition tests
+	std::vector<unsigned> groupCursor;
+	std::vector<unsigned> waiting;
+	std::vector<unsigned char> results;
+
+	std::vector<StateChange> changes;
+};
@@ -0,0 +1,772 @@
+#include "pch.h"
+
+// Microbenchmarks of the steering behaviours, the neighbourhood search, the state machines and the OBJ loader.
+// The state machine implementations are first checked to make the same transitions for many agents with the moon's machine.
+// Every benchmark is repeated for several samples, the median and the fastest sample are reported in nanoseconds per operation.
+// The results are written as CSV, compare them to the ones of an earlier build with --baseline to find regressions.
+// Build with the environment variable EXERCISE_BENCHMARK set, use a release build and run it from the Deployment directory.
+// Usage: Exercise13 [--filter=text] [--samples=N] [--sample-time=seconds] [--out=benchmark.csv] [--baseline=old.csv]
+#ifdef EXERCISE_BENCHMARK
+
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <Kore/Math/Random.h>
+
+#include "Memory.h"
+#include "Steering.h"
+#include "Flocking.h"
+#include "StateMachine.h"
+#include "BatchStateMachine.h"
+#include "CompiledStateMachine.h"
+#include "ObjLoader.h"
+#include "JobScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace {
+	struct Options {
+		// Only benchmarks whose name contains this run, nullptr for all
+		const char* filter;
+		unsigned samples;
+		// Every sample runs at least this long
+		double sampleTime;
+		const char* outFile;
+		// Results of an earlier run to compare with, nullptr for none
+		const char* baselineFile;
+	};
+
+	struct Result {
+		std::string name;
+		// The problem size, e.g. the number of boids
+		unsigned n;
+		// Iterations per sample
+		unsigned iterations;
+		double medianNs;
+		double minNs;
+	};
+
+	Options options;
+	std::vector<Result> results;
+
+	// Results are added to it, so the compiler cannot drop the benchmarked code
+	volatile float sink;
+
+	const char* optionValue(const char* argument, const char* name) {
+		size_t length = strlen(name);
+		if (strncmp(argument, name, length) == 0) return argument + length;
+		return nullptr;
+	}
+
+	bool parseOptions(int argc, char** argv) {
+		options.filter = nullptr;
+		options.samples = 5;
+		options.sampleTime = 0.05;
+		options.outFile = "benchmark.csv";
+		options.baselineFile = nullptr;
+
+		for (int i = 1; i < argc; i++) {
+			const char* value;
+			if ((value = optionValue(argv[i], "--filter=")) != nullptr) options.filter = value;
+			else if ((value = optionValue(argv[i], "--samples=")) != nullptr) options.samples = (unsigned)strtoul(value, nullptr, 10);
+			else if ((value = optionValue(argv[i], "--sample-time=")) != nullptr) options.sampleTime = strtod(value, nullptr);
+			else if ((value = optionValue(argv[i], "--out=")) != nullptr) options.outFile = value;
+			else if ((value = optionValue(argv[i], "--baseline=")) != nullptr) options.baselineFile = value;
+			else {
+				Kore::log(Kore::Error, "Unknown option %s", argv[i]);
+				return false;
+			}
+		}
+
+		if (options.samples == 0 || options.sampleTime <= 0.0) {
+			Kore::log(Kore::Error, "--samples and --sample-time have to be larger than 0");
+			return false;
+		}
+		return true;
+	}
+
+	std::string benchmarkName(const char* name, const char* parameter, unsigned value) {
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer), "%s/%s=%u", name, parameter, value);
+		return buffer;
+	}
+
+	bool selected(const std::string& name) {
+		return options.filter == nullptr || name.find(options.filter) != std::string::npos;
+	}
+
+	template<class Body> double runSeconds(Body& body, unsigned iterations) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (unsigned i = 0; i < iterations; ++i) body();
+		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	// Times body, which does operations operations per call. The iterations per sample are raised until a sample takes long enough,
+	// which also warms the caches
+	template<class Body> void measure(const std::string& name, unsigned n, unsigned operations, Body body) {
+		unsigned iterations = 1;
+		for (;;) {
+			double seconds = runSeconds(body, iterations);
+			if (seconds >= options.sampleTime) break;
+			double scale = std::min(1.2 * options.sampleTime / std::max(seconds, 1e-9), 10.0);
+			iterations = std::max(iterations + 1, (unsigned)(iterations * scale));
+		}
+
+		std::vector<double> samples(options.samples);
+		for (unsigned sample = 0; sample < options.samples; ++sample) {
+			samples[sample] = runSeconds(body, iterations) * 1e9 / ((double)iterations * operations);
+		}
+		std::sort(samples.begin(), samples.end());
+
+		Result result;
+		result.name = name;
+		result.n = n;
+		result.iterations = iterations;
+		result.medianNs = samples[samples.size() / 2];
+		result.minNs = samples[0];
+		results.push_back(result);
+		Kore::log(Kore::Info, "%-48s %12.1f ns/op (min %.1f, %u iterations)", name.c_str(), result.medianNs, result.minNs, iterations);
+	}
+
+	// Characters spread evenly over the square [-halfSize, halfSize] with random velocities
+	std::vector<AICharacter*> createCharacters(unsigned count, float halfSize) {
+		std::vector<AICharacter*> characters(count);
+		for (unsigned i = 0; i < count; ++i) {
+			AICharacter* character = new AICharacter();
+			character->Position[0] = Wander::randomReal(2.0f * halfSize) - halfSize;
+			character->Position[1] = Wander::randomReal(2.0f * halfSize) - halfSize;
+			character->Orientation = Wander::randomReal(Kore::pi);
+			character->Velocity[0] = Wander::randomBinomial(2.0f);
+			character->Velocity[1] = Wander::randomReal(2.0f);
+			character->Rotation = 0.0f;
+			character->meshObject = nullptr;
+			characters[i] = character;
+		}
+		return characters;
+	}
+
+	void destroyCharacters(std::vector<AICharacter*>& characters) {
+		for (unsigned i = 0; i < characters.size(); ++i) delete characters[i];
+		characters.clear();
+	}
+
+	// The characters a behaviour is run for in turn, so not every call sees the same input
+	const unsigned behaviourCharacters = 1024;
+
+	void benchmarkBehaviour(const char* name, SteeringBehaviour& behaviour) {
+		std::string fullName = benchmarkName(name, "n", behaviourCharacters);
+		if (!selected(fullName)) return;
+
+		std::vector<AICharacter*> characters = createCharacters(behaviourCharacters, 3.0f);
+		measure(fullName, behaviourCharacters, behaviourCharacters, [&]() {
+			SteeringOutput steer;
+			float sum = 0.0f;
+			for (unsigned i = 0; i < characters.size(); ++i) {
+				behaviour.character = characters[i];
+				behaviour.getSteering(&steer);
+				sum += steer.linear.x();
+			}
+			sink = sink + sum;
+		});
+		destroyCharacters(characters);
+	}
+
+	void benchmarkBasicBehaviours() {
+		Kore::vec2 target(0.5f, -0.5f);
+
+		Seek seek;
+		seek.target = &target;
+		seek.maxAcceleration = 3.0f;
+		benchmarkBehaviour("Seek::getSteering", seek);
+
+		Flee flee;
+		flee.target = &target;
+		flee.maxAcceleration = 3.0f;
+		benchmarkBehaviour("Flee::getSteering", flee);
+
+		Wander wander;
+		wander.maxAcceleration = 2.0f;
+		wander.turnSpeed = 2.0f;
+		wander.volatility = 20.0f;
+		benchmarkBehaviour("Wander::getSteering", wander);
+	}
+
+	// The largest neighbourhood size of the boid behaviours, used as the grid cell size like in the simulation
+	const float maxNeighbourhoodSize = 2.0f;
+
+	// Boids per square unit in the flocking benchmarks, a bit denser than the exercise
+	const float flockDensity = 8.0f;
+
+	// Half the size of a square world that holds count boids at the given density
+	float worldHalfSize(unsigned count, float density) {
+		return 0.5f * sqrtf(count / density);
+	}
+
+	// The three boid behaviours with the settings of the simulation
+	struct BoidBehaviours {
+		Separation separation;
+		Cohesion cohesion;
+		VelocityMatchAndAlign velocityMatch;
+
+		explicit BoidBehaviours(Flock* flock) {
+			separation.maxAcceleration = 2.0f;
+			separation.neighbourhoodSize = 1.0f;
+			separation.neighbourhoodMinDP = -1.0f;
+			separation.theFlock = flock;
+
+			cohesion.maxAcceleration = 2.0f;
+			cohesion.neighbourhoodSize = 1.0f;
+			cohesion.neighbourhoodMinDP = 0.0f;
+			cohesion.theFlock = flock;
+
+			velocityMatch.maxAcceleration = 2.0f;
+			velocityMatch.neighbourhoodSize = 2.0f;
+			velocityMatch.neighbourhoodMinDP = 0.0f;
+			velocityMatch.theFlock = flock;
+		}
+	};
+
+	// One tick of flock steering for every boid: the grid is rebuilt and each boid gets its steering, the boids do not move
+	void benchmarkBoidSteering(unsigned count) {
+		std::string blendedName = benchmarkName("BlendedSteering/boids", "n", count);
+		std::string fusedName = benchmarkName("FlockingSteering", "n", count);
+		if (!selected(blendedName) && !selected(fusedName)) return;
+
+		float halfSize = worldHalfSize(count, flockDensity);
+		std::vector<AICharacter*> boids = createCharacters(count, halfSize);
+		Flock flock;
+		flock.storage = Flock::SoAStorage;
+		flock.boids.assign(boids.begin(), boids.end());
+		BoidBehaviours behaviours(&flock);
+
+		if (selected(blendedName)) {
+			BlendedSteering blended;
+			blended.behaviours.push_back(BlendedSteering::BehaviourAndWeight(&behaviours.separation, 0.1f));
+			blended.behaviours.push_back(BlendedSteering::BehaviourAndWeight(&behaviours.cohesion, 1.0f));
+			blended.behaviours.push_back(BlendedSteering::BehaviourAndWeight(&behaviours.velocityMatch, 2.0f));
+
+			measure(blendedName, count, count, [&]() {
+				flock.buildGrid(halfSize, maxNeighbourhoodSize);
+				SteeringOutput steer;
+				float sum = 0.0f;
+				for (unsigned i = 0; i < count; ++i) {
+					blended.character = boids[i];
+					blended.getSteering(&steer);
+					sum += steer.linear.x();
+				}
+				sink = sink + sum;
+			});
+		}
+
+		if (selected(fusedName)) {
+			FlockingSteering fused;
+			fused.theFlock = &flock;
+			fused.separation = &behaviours.separation;
+			fused.separationWeight = 0.1f;
+			fused.cohesion = &behaviours.cohesion;
+			fused.cohesionWeight = 1.0f;
+			fused.velocityMatch = &behaviours.velocityMatch;
+			fused.velocityMatchWeight = 2.0f;
+
+			NeighbourScratch scratch;
+			std::vector<unsigned> candidates;
+			measure(fusedName, count, count, [&]() {
+				flock.buildGrid(halfSize, maxNeighbourhoodSize);
+				SteeringOutput steer;
+				float sum = 0.0f;
+				for (unsigned i = 0; i < count; ++i) {
+					fused.getSteering(i, scratch, candidates, &steer);
+					sum += steer.linear.x();
+				}
+				sink = sink + sum;
+			});
+		}
+
+		destroyCharacters(boids);
+	}
+
+	// Neighbourhood queries for every boid of a flock with a fixed number of boids, packed more and more densely
+	void benchmarkNeighbourhood(Flock::Storage storage, const char* storageName) {
+		const unsigned count = 1000;
+		const float densities[] = { 1.0f, 4.0f, 16.0f, 64.0f };
+
+		for (unsigned d = 0; d < sizeof(densities) / sizeof(densities[0]); ++d) {
+			char name[128];
+			snprintf(name, sizeof(name), "Flock::prepareNeighourhood/%s/density=%g", storageName, densities[d]);
+			if (!selected(name)) continue;
+
+			float halfSize = worldHalfSize(count, densities[d]);
+			std::vector<AICharacter*> boids = createCharacters(count, halfSize);
+			Flock flock;
+			flock.storage = storage;
+			flock.boids.assign(boids.begin(), boids.end());
+			flock.buildGrid(halfSize, maxNeighbourhoodSize);
+
+			measure(name, count, count, [&]() {
+				unsigned found = 0;
+				for (unsigned i = 0; i < count; ++i) {
+					found += flock.prepareNeighourhood(boids[i], 1.0f, 0.0f);
+				}
+				sink = sink + (float)found;
+			});
+			destroyCharacters(boids);
+		}
+	}
+
+	// Counts how often it was executed
+	class CountingAction : public Action {
+	public:
+		virtual void act() {
+			sink = sink + 1.0f;
+		}
+	};
+
+	class CountingState : public StateMachineState {
+	public:
+		virtual Action* getEntryActions() {
+			return createFrameAction<CountingAction>();
+		}
+	};
+
+	class ConditionalTransition :
+	public Transition,
+	public ConditionalTransitionMixin,
+	public FixedTargetTransitionMixin
+	{
+	public:
+		virtual bool isTriggered() {
+			return ConditionalTransitionMixin::isTriggered();
+		}
+
+		virtual StateMachineState* getTargetState() {
+			return FixedTargetTransitionMixin::getTargetState();
+		}
+	};
+
+	// Two states that lead into each other, the transitions fire in every update if transitions is true
+	void benchmarkStateMachine(bool transitions) {
+		const unsigned updates = 1000;
+		std::string name = benchmarkName(transitions ? "StateMachine::update/transitions" : "StateMachine::update/no-transitions", "n", updates);
+		if (!selected(name)) return;
+
+		int watched = 0;
+		IntegerMatchCondition condition;
+		condition.watch = &watched;
+		condition.target = transitions ? 0 : 1;
+
+		CountingState first;
+		CountingState second;
+		ConditionalTransition toSecond;
+		toSecond.condition = &condition;
+		toSecond.target = &second;
+		toSecond.next = nullptr;
+		ConditionalTransition toFirst;
+		toFirst.condition = &condition;
+		toFirst.target = &first;
+		toFirst.next = nullptr;
+		first.firstTransition = &toSecond;
+		second.firstTransition = &toFirst;
+
+		StateMachine machine;
+		machine.initialState = &first;
+		machine.currentState = &first;
+
+		// The actions are run like in the simulation and the frame memory they take is released after every iteration
+		measure(name, updates, updates, [&]() {
+			for (unsigned i = 0; i < updates; ++i) {
+				for (Action* action = machine.update(); action != nullptr; action = action->next) {
+					action->act();
+				}
+			}
+			Memory::resetFrame();
+		});
+	}
+
+	// Agents with the moon's machine: they wander until their target is closer than this, then follow it until it is further away again
+	const float moonTransitionDistance = 1.0f;
+
+	class DistanceCondition : public Condition {
+	public:
+		const Kore::vec2* first;
+		const Kore::vec2* second;
+		bool checkIfCloser;
+
+		// Compares squared distances like DistanceBatchCondition, so all machines decide the same
+		virtual bool test() {
+			Kore::vec2 offset = *first - *second;
+			float squared = offset.x() * offset.x() + offset.y() * offset.y();
+			float distanceSquared = moonTransitionDistance * moonTransitionDistance;
+			return checkIfCloser ? squared < distanceSquared : squared >= distanceSquared;
+		}
+	};
+
+	// The moon's StateMachine for one agent, with its own states, transitions and conditions
+	struct ObjectMoonAgent {
+		CountingState wandering;
+		CountingState following;
+		ConditionalTransition toFollowing;
+		ConditionalTransition toWandering;
+		DistanceCondition closer;
+		DistanceCondition further;
+		StateMachine machine;
+
+		ObjectMoonAgent(const Kore::vec2* position, const Kore::vec2* target) {
+			closer.first = position;
+			closer.second = target;
+			closer.checkIfCloser = true;
+			further = closer;
+			further.checkIfCloser = false;
+
+			toFollowing.condition = &closer;
+			toFollowing.target = &following;
+			toFollowing.next = nullptr;
+			toWandering.condition = &further;
+			toWandering.target = &wandering;
+			toWandering.next = nullptr;
+			wandering.firstTransition = &toFollowing;
+			following.firstTransition = &toWandering;
+
+			machine.initialState = &wandering;
+			machine.currentState = &wandering;
+		}
+
+		// 0 while wandering and 1 while following, like the state indices of the other machines
+		unsigned getState() const {
+			return machine.currentState == &following ? 1 : 0;
+		}
+
+	private:
+		ObjectMoonAgent(const ObjectMoonAgent&);
+		ObjectMoonAgent& operator=(const ObjectMoonAgent&);
+	};
+
+	// Many agents with the moon's machine as StateMachine objects, as a StateMachineBatch and as a CompiledStateMachine.
+	// Every agent has its own target, move puts the targets alternately nearer and further, so many agents switch state in every update
+	struct MoonAgents {
+		std::vector<Kore::vec2> positions;
+		std::vector<Kore::vec2> targets;
+		std::vector<Kore::vec2> nearTargets;
+		std::vector<Kore::vec2> farTargets;
+
+		std::vector<ObjectMoonAgent*> objects;
+
+		DistanceBatchCondition closer;
+		DistanceBatchCondition further;
+		StateMachineDefinition definition;
+		StateMachineBatch batch;
+
+		CompiledStateMachine compiled;
+		std::vector<unsigned short> compiledStates;
+		std::vector<CompiledStateMachine::Firing> firings;
+
+		explicit MoonAgents(unsigned count) : positions(count), targets(count), nearTargets(count), farTargets(count), batch(&definition) {
+			for (unsigned i = 0; i < count; ++i) {
+				positions[i] = Kore::vec2(Wander::randomBinomial(3.0f), Wander::randomBinomial(3.0f));
+				float angle = Wander::randomReal(2.0f * Kore::pi);
+				Kore::vec2 offset = Kore::vec2(Kore::cos(angle), Kore::sin(angle)) * (0.5f + Wander::randomReal(1.0f));
+				nearTargets[i] = positions[i] + offset * 0.8f;
+				farTargets[i] = positions[i] + offset * 1.2f;
+			}
+			targets = nearTargets;
+
+			closer.transitionDistance = moonTransitionDistance;
+			closer.checkIfCloser = true;
+			further.transitionDistance = moonTransitionDistance;
+			further.checkIfCloser = false;
+			for (unsigned i = 0; i < count; ++i) {
+				objects.push_back(new ObjectMoonAgent(&positions[i], &targets[i]));
+				closer.first.push_back(&positions[i]);
+				closer.second.push_back(&targets[i]);
+				batch.addAgent();
+			}
+			further.first = closer.first;
+			further.second = closer.second;
+
+			unsigned wandering = definition.addState();
+			unsigned following = definition.addState();
+			definition.addTransition(wandering, following, &closer);
+			definition.addTransition(following, wandering, &further);
+			definition.initialState = wandering;
+
+			// Only entering the following state has an action, so one transition has none like in the batch
+			wandering = compiled.addState();
+			following = compiled.addState();
+			unsigned closerId = compiled.addDistance(&positions[0], sizeof(Kore::vec2), &targets[0], sizeof(Kore::vec2), moonTransitionDistance, true);
+			unsigned furtherId = compiled.addDistance(&positions[0], sizeof(Kore::vec2), &targets[0], sizeof(Kore::vec2), moonTransitionDistance, false);
+			const unsigned followAction = 0;
+			compiled.addTransition(wandering, closerId, following, &followAction, 1);
+			compiled.addTransition(following, furtherId, wandering);
+			compiled.initialState = wandering;
+			compiled.compile();
+			compiledStates.assign(count, (unsigned short)compiled.initialState);
+		}
+
+		~MoonAgents() {
+			for (unsigned i = 0; i < objects.size(); ++i) delete objects[i];
+		}
+
+		// Copies instead of assigning, the conditions point into targets
+		void move(unsigned step) {
+			const std::vector<Kore::vec2>& source = step % 2 == 0 ? farTargets : nearTargets;
+			std::copy(source.begin(), source.end(), targets.begin());
+		}
+
+		// Runs the actions like the simulation does, their frame memory is released by the caller
+		void updateObjects() {
+			for (unsigned i = 0; i < objects.size(); ++i) {
+				for (Action* action = objects[i]->machine.update(); action != nullptr; action = action->next) {
+					action->act();
+				}
+			}
+		}
+
+		// Counts the state changes in place of running an action for each
+		void updateBatch() {
+			sink = sink + (float)batch.update().size();
+		}
+
+		// Counts the action ids of the transitions taken
+		void updateCompiled() {
+			firings.clear();
+			compiled.update(&compiledStates[0], (unsigned)compiledStates.size(), firings);
+			unsigned actions = 0;
+			for (unsigned i = 0; i < firings.size(); ++i) {
+				const unsigned* ids = compiled.getActions(firings[i].transition);
+				for (unsigned a = 0; a < compiled.getTransition(firings[i].transition).actionCount; ++a) {
+					actions += ids[a] + 1;
+				}
+			}
+			sink = sink + (float)actions;
+		}
+	};
+
+	// Runs the machines side by side and compares the states of all agents after every update
+	bool checkMoonMachines() {
+		MoonAgents agents(1000);
+		for (unsigned step = 0; step < 16; ++step) {
+			agents.move(step);
+			agents.updateObjects();
+			agents.updateBatch();
+			agents.updateCompiled();
+			Memory::resetFrame();
+
+			for (unsigned i = 0; i < agents.objects.size(); ++i) {
+				unsigned expected = agents.objects[i]->getState();
+				if (agents.batch.getState(i) != expected) {
+					Kore::log(Kore::Error, "Update %u: agent %u is in state %u of the StateMachineBatch instead of %u", step, i, agents.batch.getState(i), expected);
+					return false;
+				}
+				if (agents.compiledStates[i] != expected) {
+					Kore::log(Kore::Error, "Update %u: agent %u is in state %u of the CompiledStateMachine instead of %u", step, i, (unsigned)agents.compiledStates[i], expected);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// The moon's machine for many agents, with the targets fixed so hardly any agent switches, or moved in every update
+	void benchmarkMoonMachines(bool switching) {
+		const unsigned count = 10000;
+		const char* mode = switching ? "switching" : "steady";
+		char objectName[128];
+		char batchName[128];
+		char compiledName[128];
+		snprintf(objectName, sizeof(objectName), "MoonStateMachine/object/%s/n=%u", mode, count);
+		snprintf(batchName, sizeof(batchName), "MoonStateMachine/batched/%s/n=%u", mode, count);
+		snprintf(compiledName, sizeof(compiledName), "MoonStateMachine/compiled/%s/n=%u", mode, count);
+		if (!selected(objectName) && !selected(batchName) && !selected(compiledName)) return;
+
+		MoonAgents agents(count);
+		unsigned step = 0;
+		if (selected(objectName)) {
+			measure(objectName, count, count, [&]() {
+				if (switching) agents.move(step++);
+				agents.updateObjects();
+				Memory::resetFrame();
+			});
+		}
+		if (selected(batchName)) {
+			measure(batchName, count, count, [&]() {
+				if (switching) agents.move(step++);
+				agents.updateBatch();
+			});
+		}
+		if (selected(compiledName)) {
+			measure(compiledName, count, count, [&]() {
+				if (switching) agents.move(step++);
+				agents.updateCompiled();
+			});
+		}
+	}
+
+	void benchmarkIntegrate() {
+		const unsigned count = 1000;
+		std::string name = benchmarkName("AICharacter::integrate", "n", count);
+		if (!selected(name)) return;
+
+		std::vector<AICharacter*> characters = createCharacters(count, 3.0f);
+		SteeringOutput steer;
+		steer.linear = Kore::vec2(0.5f, -0.25f);
+		steer.angular = 0.1f;
+		measure(name, count, count, [&]() {
+			for (unsigned i = 0; i < count; ++i) {
+				characters[i]->integrate(steer, 0.7f, 1.0f / 60.0f);
+			}
+		});
+		sink = sink + characters[0]->Position.x();
+		destroyCharacters(characters);
+	}
+
+	// The .obj files in the directory, sorted by name
+	std::vector<std::string> listObjFiles(const char* directory) {
+		std::vector<std::string> files;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((std::string(directory) + "/*.obj").c_str(), &data);
+		if (find != INVALID_HANDLE_VALUE) {
+			do {
+				files.push_back(std::string(directory) + "/" + data.cFileName);
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+		}
+#else
+		DIR* dir = opendir(directory);
+		if (dir != nullptr) {
+			while (dirent* entry = readdir(dir)) {
+				size_t length = strlen(entry->d_name);
+				if (length > 4 && strcmp(entry->d_name + length - 4, ".obj") == 0) {
+					files.push_back(std::string(directory) + "/" + entry->d_name);
+				}
+			}
+			closedir(dir);
+		}
+#endif
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	// Loads every level mesh alone and with the scheduler, the level memory is released after every load
+	void benchmarkObjLoading() {
+		std::vector<std::string> files = listObjFiles("Level");
+		if (files.empty()) {
+			Kore::log(Kore::Warning, "No .obj files in Level, run the benchmark from the Deployment directory");
+			return;
+		}
+
+		JobScheduler scheduler;
+		for (unsigned f = 0; f < files.size(); ++f) {
+			const char* file = files[f].c_str();
+			std::string serialName = std::string("loadObj/") + file;
+			std::string parallelName = std::string("loadObj/parallel/") + file;
+
+			if (selected(serialName)) {
+				measure(serialName, 1, 1, [&]() {
+					sink = sink + (float)loadObj(file)->numVertices;
+					Memory::resetLevel();
+				});
+			}
+			if (selected(parallelName)) {
+				measure(parallelName, 1, 1, [&]() {
+					sink = sink + (float)loadObj(file, &scheduler)->numVertices;
+					Memory::resetLevel();
+				});
+			}
+		}
+	}
+
+	bool writeResults(const char* filename) {
+		FILE* file = fopen(filename, "w");
+		if (file == nullptr) return false;
+		fprintf(file, "name,n,iterations,median_ns_per_op,min_ns_per_op\n");
+		for (unsigned i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			fprintf(file, "%s,%u,%u,%.3f,%.3f\n", result.name.c_str(), result.n, result.iterations, result.medianNs, result.minNs);
+		}
+		return fclose(file) == 0;
+	}
+
+	// Logs how much the median of every benchmark changed against the baseline file
+	bool compareWithBaseline(const char* filename) {
+		FILE* file = fopen(filename, "r");
+		if (file == nullptr) return false;
+
+		char line[512];
+		// Skip the header
+		if (fgets(line, sizeof(line), file) == nullptr) {
+			fclose(file);
+			return false;
+		}
+		while (fgets(line, sizeof(line), file) != nullptr) {
+			char* comma = strchr(line, ',');
+			if (comma == nullptr) continue;
+			*comma = 0;
+			unsigned n, iterations;
+			double medianNs, minNs;
+			if (sscanf(comma + 1, "%u,%u,%lf,%lf", &n, &iterations, &medianNs, &minNs) != 4 || medianNs <= 0.0) continue;
+
+			for (unsigned i = 0; i < results.size(); ++i) {
+				if (results[i].name != line) continue;
+				double change = (results[i].medianNs / medianNs - 1.0) * 100.0;
+				// Changes below 5% are mostly noise
+				Kore::LogLevel level = change > 5.0 ? Kore::Warning : Kore::Info;
+				Kore::log(level, "%-48s %12.1f -> %.1f ns/op (%+.1f%%)", line, medianNs, results[i].medianNs, change);
+			}
+		}
+		fclose(file);
+		return true;
+	}
+}
+
+int kore(int argc, char** argv) {
+	if (!parseOptions(argc, argv)) return 1;
+
+	Memory::init();
+	Kore::Random::init(42);
+
+	// Benchmarks of machines that decide differently would be meaningless
+	if (!checkMoonMachines()) return 1;
+
+#ifndef NDEBUG
+	Kore::log(Kore::Warning, "This is a debug build, the results are not representative");
+#endif
+
+	benchmarkBasicBehaviours();
+	const unsigned boidCounts[] = { 100, 1000, 10000, 100000 };
+	for (unsigned i = 0; i < sizeof(boidCounts) / sizeof(boidCounts[0]); ++i) {
+		benchmarkBoidSteering(boidCounts[i]);
+	}
+	benchmarkNeighbourhood(Flock::ListStorage, "list");
+	benchmarkNeighbourhood(Flock::SoAStorage, "soa");
+	benchmarkStateMachine(false);
+	benchmarkStateMachine(true);
+	benchmarkMoonMachines(false);
+	benchmarkMoonMachines(true);
+	benchmarkIntegrate();
+	benchmarkObjLoading();
+
+	if (!writeResults(options.outFile)) {
+		Kore::log(Kore::Error, "Could not write %s", options.outFile);
+		return 1;
+	}
+	if (options.baselineFile != nullptr && !compareWithBaseline(options.baselineFile)) {
+		Kore::log(Kore::Error, "Could not read %s", options.baselineFile);
+		return 1;
+	}
+	return 0;
+}
+
+#endif
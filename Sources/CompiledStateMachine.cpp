@@ -0,0 +1,171 @@
+#include "pch.h"
+#include "CompiledStateMachine.h"
+
+#include <algorithm>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	bool compareSource(const CompiledStateMachine::CompiledTransition& a, const CompiledStateMachine::CompiledTransition& b)
+	{
+		return a.from < b.from;
+	}
+	
+	CompiledStateMachine::CompiledCondition emptyCondition(CompiledStateMachine::ConditionKind kind)
+	{
+		CompiledStateMachine::CompiledCondition condition;
+		condition.kind = kind;
+		condition.first = nullptr;
+		condition.firstStride = 0;
+		condition.second = nullptr;
+		condition.secondStride = 0;
+		condition.target = 0;
+		condition.distanceSquared = 0.0f;
+		condition.left = 0;
+		condition.right = 0;
+		return condition;
+	}
+}
+
+CompiledStateMachine::CompiledStateMachine()
+:
+initialState(0), stateCount(0)
+{}
+
+unsigned CompiledStateMachine::addState()
+{
+	return stateCount++;
+}
+
+unsigned CompiledStateMachine::addCondition(const CompiledCondition& condition)
+{
+	conditions.push_back(condition);
+	return conditions.size() - 1;
+}
+
+unsigned CompiledStateMachine::addIntegerMatch(const int* watch, size_t stride, int target)
+{
+	CompiledCondition condition = emptyCondition(IntegerMatch);
+	condition.first = (const char*)watch;
+	condition.firstStride = stride;
+	condition.target = target;
+	return addCondition(condition);
+}
+
+unsigned CompiledStateMachine::addDistance(const vec2* first, size_t firstStride, const vec2* second, size_t secondStride, float distance, bool checkIfCloser)
+{
+	CompiledCondition condition = emptyCondition(checkIfCloser ? DistanceLess : DistanceAtLeast);
+	condition.first = (const char*)first;
+	condition.firstStride = firstStride;
+	condition.second = (const char*)second;
+	condition.secondStride = secondStride;
+	condition.distanceSquared = distance * distance;
+	return addCondition(condition);
+}
+
+unsigned CompiledStateMachine::addAnd(unsigned left, unsigned right)
+{
+	assert(left < conditions.size() && right < conditions.size());
+	CompiledCondition condition = emptyCondition(And);
+	condition.left = left;
+	condition.right = right;
+	return addCondition(condition);
+}
+
+unsigned CompiledStateMachine::addOr(unsigned left, unsigned right)
+{
+	assert(left < conditions.size() && right < conditions.size());
+	CompiledCondition condition = emptyCondition(Or);
+	condition.left = left;
+	condition.right = right;
+	return addCondition(condition);
+}
+
+unsigned CompiledStateMachine::addNot(unsigned inner)
+{
+	assert(inner < conditions.size());
+	CompiledCondition condition = emptyCondition(Not);
+	condition.left = inner;
+	return addCondition(condition);
+}
+
+void CompiledStateMachine::addTransition(unsigned from, unsigned condition, unsigned to, const unsigned* actionIds, unsigned actionCount)
+{
+	assert(from < stateCount && to < stateCount && condition < conditions.size());
+	CompiledTransition transition;
+	transition.from = from;
+	transition.condition = condition;
+	transition.to = to;
+	transition.firstAction = actions.size();
+	transition.actionCount = actionCount;
+	actions.insert(actions.end(), actionIds, actionIds + actionCount);
+	transitions.push_back(transition);
+}
+
+void CompiledStateMachine::compile()
+{
+	// Keeps the order of the transitions of each state
+	std::stable_sort(transitions.begin(), transitions.end(), compareSource);
+	
+	stateTransitions.assign(stateCount + 1, 0);
+	for (unsigned t = 0; t < transitions.size(); ++t)
+	{
+		stateTransitions[transitions[t].from + 1]++;
+	}
+	for (unsigned s = 0; s < stateCount; ++s)
+	{
+		stateTransitions[s + 1] += stateTransitions[s];
+	}
+}
+
+bool CompiledStateMachine::test(unsigned id, unsigned agent) const
+{
+	const CompiledCondition& condition = conditions[id];
+	switch (condition.kind)
+	{
+	case IntegerMatch:
+		return *(const int*)(condition.first + agent * condition.firstStride) == condition.target;
+	case DistanceLess:
+	case DistanceAtLeast:
+	{
+		const vec2& first = *(const vec2*)(condition.first + agent * condition.firstStride);
+		const vec2& second = *(const vec2*)(condition.second + agent * condition.secondStride);
+		float dx = first.x() - second.x();
+		float dy = first.y() - second.y();
+		float squared = dx * dx + dy * dy;
+		return condition.kind == DistanceLess ? squared < condition.distanceSquared : squared >= condition.distanceSquared;
+	}
+	case And:
+		return test(condition.left, agent) && test(condition.right, agent);
+	case Or:
+		return test(condition.left, agent) || test(condition.right, agent);
+	case Not:
+		return !test(condition.left, agent);
+	}
+	return false;
+}
+
+int CompiledStateMachine::findTransition(unsigned state, unsigned agent) const
+{
+	for (unsigned t = stateTransitions[state]; t < stateTransitions[state + 1]; ++t)
+	{
+		if (test(transitions[t].condition, agent)) return (int)t;
+	}
+	return -1;
+}
+
+void CompiledStateMachine::update(unsigned short* states, unsigned count, std::vector<Firing>& fired) const
+{
+	for (unsigned agent = 0; agent < count; ++agent)
+	{
+		int transition = findTransition(states[agent], agent);
+		if (transition < 0) continue;
+		
+		states[agent] = (unsigned short)transitions[transition].to;
+		Firing firing;
+		firing.agent = agent;
+		firing.transition = (unsigned)transition;
+		fired.push_back(firing);
+	}
+}
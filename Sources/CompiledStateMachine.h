@@ -0,0 +1,163 @@
+#pragma once
+
+#include <Kore/Math/Vector.h>
+
+#include <stddef.h>
+#include <vector>
+
+/**
+* @file
+*
+* A state machine compiled into flat tables. States are integers,
+* transitions are rows of (from, condition, to, action range) sorted
+* by source state, and conditions come from a closed set of kinds
+* that are evaluated with a switch instead of virtual calls.
+*
+* The machine is shared by any number of agents. Conditions read
+* their inputs from base pointers plus a byte stride per agent, so one
+* condition covers e.g. the positions of all agents stored in an
+* array (a stride of 0 reads the same value for every agent).
+*/
+class CompiledStateMachine
+{
+public:
+	/**
+	* The kinds of conditions a compiled machine can test.
+	*/
+	enum ConditionKind
+	{
+		// The watched integer equals the target, like IntegerMatchCondition
+		IntegerMatch,
+		// Two points are closer than the distance
+		DistanceLess,
+		// Two points are at least the distance apart
+		DistanceAtLeast,
+		// Combinations of two (And, Or) or one (Not) other conditions
+		And,
+		Or,
+		Not
+	};
+
+	struct CompiledCondition
+	{
+		ConditionKind kind;
+
+		// IntegerMatch: the watched integer, DistanceLess/AtLeast: the first point
+		const char* first;
+		size_t firstStride;
+
+		// DistanceLess/AtLeast: the second point
+		const char* second;
+		size_t secondStride;
+
+		int target;
+		float distanceSquared;
+
+		// And, Or, Not: the combined conditions
+		unsigned left;
+		unsigned right;
+	};
+
+	struct CompiledTransition
+	{
+		unsigned from;
+		unsigned condition;
+		unsigned to;
+
+		// The actions of the transition are actions[firstAction, firstAction + actionCount)
+		unsigned firstAction;
+		unsigned actionCount;
+	};
+
+	/**
+	* A transition taken by an agent during update.
+	*/
+	struct Firing
+	{
+		unsigned agent;
+		unsigned transition;
+	};
+
+	CompiledStateMachine();
+
+	/**
+	* Adds a state and returns its index.
+	*/
+	unsigned addState();
+
+	/**
+	* Adds a condition and returns its id. Conditions can only refer
+	* to conditions added before them.
+	*/
+	unsigned addIntegerMatch(const int* watch, size_t stride, int target);
+	unsigned addDistance(const Kore::vec2* first, size_t firstStride, const Kore::vec2* second, size_t secondStride, float distance, bool checkIfCloser);
+	unsigned addAnd(unsigned left, unsigned right);
+	unsigned addOr(unsigned left, unsigned right);
+	unsigned addNot(unsigned condition);
+
+	/**
+	* Adds a transition with a list of action ids that the caller
+	* runs when the transition fires. Transitions from the same state
+	* are checked in the order in which they are added.
+	*/
+	void addTransition(unsigned from, unsigned condition, unsigned to, const unsigned* actionIds = nullptr, unsigned actionCount = 0);
+
+	/**
+	* Sorts the transitions by source state and builds the lookup per
+	* state. Call after adding everything and before updating.
+	*/
+	void compile();
+
+	/**
+	* Evaluates a condition for an agent.
+	*/
+	bool test(unsigned condition, unsigned agent) const;
+
+	/**
+	* Returns the index of the first transition out of the state that
+	* triggers for the agent, or -1.
+	*/
+	int findTransition(unsigned state, unsigned agent) const;
+
+	/**
+	* Updates the states of count agents (agent i is in states[i]) and
+	* appends a Firing for every transition taken to fired.
+	*/
+	void update(unsigned short* states, unsigned count, std::vector<Firing>& fired) const;
+
+	const CompiledTransition& getTransition(unsigned transition) const
+	{
+		return transitions[transition];
+	}
+
+	/**
+	* Returns the action ids of a transition, getTransition tells how
+	* many there are.
+	*/
+	const unsigned* getActions(unsigned transition) const
+	{
+		// A transition without actions may start at the end of the array
+		return actions.data() + transitions[transition].firstAction;
+	}
+
+	unsigned getStateCount() const
+	{
+		return stateCount;
+	}
+
+	/**
+	* The state agents start in.
+	*/
+	unsigned initialState;
+
+private:
+	unsigned addCondition(const CompiledCondition& condition);
+
+	unsigned stateCount;
+	std::vector<CompiledCondition> conditions;
+	std::vector<CompiledTransition> transitions;
+	std::vector<unsigned> actions;
+
+	// The transitions of state s are transitions[stateTransitions[s], stateTransitions[s + 1])
+	std::vector<unsigned> stateTransitions;
+};
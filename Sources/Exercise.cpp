@@ -13,9 +13,16 @@
 
 #include "Memory.h"
 #include "MeshObject.h"
+#include "AssetLoader.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
 #include "Steering.h"
-#include "Flocking.h"
-#include "StateMachine.h"
+#include "Simulation.h"
+
+#include <vector>
+
+// The other builds bring their own kore, see Headless.cpp, Benchmark.cpp and MeshConverter.cpp
+#if !defined(EXERCISE_HEADLESS) && !defined(EXERCISE_MESH_CONVERTER) && !defined(EXERCISE_BENCHMARK)
 
 namespace {
 	using namespace Kore;
@@ -24,60 +31,51 @@ namespace {
 	const int width = 512;
 	const int height = 512;
 	
-	// The world is viewed using an orthographic projection and represents toroidal space: Objects that leave on one side come out on the other side.
-	const float worldSize = 3.0f;
-	
-	// Trims the input variable to be inside the world size
-	void TrimWorld(float& x)
-	{
-		if (x < -worldSize) x = worldSize;
-		if (x > worldSize) x = -worldSize;
-	}
-	
 	// Time
 	double startTime;
 	double lastTime;
 	
-	// The number of boids in the simulation. If using more, make objects[] larger
-	const int numBoids = 20;
+	// The AI always advances in ticks of this duration, independent of the frame rate
+	const float fixedDeltaT = 1.0f / 60.0f;
 	
-	// Array holding the boids
-	AICharacter* boids[numBoids];
+	// At most this many ticks per frame. After a hitch the AI slows down instead of taking ever more ticks to catch up
+	const int maxTicksPerFrame = 5;
 	
-	// AI Characters for the moon and the Earth
-	AICharacter* moon;
-	AICharacter* earth;
+	// Frame time that has not been simulated yet, always less than one tick after update
+	double accumulator;
 	
-	// Management for the whole flock
-	Flock flock;
+	// Seconds between the memory usage reports in the log
+	const double usageLogInterval = 10.0;
+	double lastUsageLog;
 	
-	// Flock steering component, blends the three involved delegated steering behaviours
-	BlendedSteering* flockSteering;
+	// Where a character was before the last tick, rendering blends between this and the current state
+	struct CharacterState {
+		vec2 position;
+		float orientation;
+	};
+	std::vector<CharacterState> previousStates;
 	
-	// The three steering components that flockSteering blends together
-	Separation* separation;
-	Cohesion* cohesion;
-	VelocityMatchAndAlign* vMA;
+	// Loads the meshes and textures while the first frames are already shown
+	AssetLoader* assetLoader;
 	
-	// Vector to hold steering information from the keyboard
-	vec2 deltaPosition;
-	
-	// The two behaviours for the moon AI - wander and seek
-	Wander* wander;
-	Seek* seek;
+	// Time per frame for moving loaded assets to the GPU
+	const double uploadBudget = 0.004;
 	
-	// The current steering behaviour for the moon
-	SteeringBehaviour* moonBehaviour;
+	// The number of boids in the simulation
+	const int numBoids = 20;
 	
-	// State machine for the moon's behaviour
-	StateMachine moonStateMachine;
+	// Vector to hold steering information from the keyboard
+	vec2 deltaPosition;
 	
 	Graphics4::Shader* vertexShader;
 	Graphics4::Shader* fragmentShader;
 	Graphics4::PipelineState* pipeline;
 	
-	// null terminated array of MeshObject pointers
-	MeshObject* objects[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+	// Everything that is drawn, objects can be added and removed at any time
+	std::vector<MeshObject*> objects;
+	
+	// Sorts and batches the draws of a frame
+	RenderQueue* renderQueue;
 	
 	// The view projection matrix aka the camera
 	mat4 P;
@@ -87,234 +85,142 @@ namespace {
 	Graphics4::TextureUnit tex;
 	Graphics4::ConstantLocation pLocation;
 	Graphics4::ConstantLocation vLocation;
-	Graphics4::ConstantLocation mLocation;
 	
-	// State for managing actions in the state machine
-	enum State { Wandering, Following };
+	// The characters in the order of previousStates: the moon, the Earth, the boids
+	AICharacter* getCharacter(unsigned index) {
+		if (index == 0) return Simulation::getMoon();
+		if (index == 1) return Simulation::getEarth();
+		return Simulation::getBoid(index - 2);
+	}
 	
+	void savePreviousStates() {
+		previousStates.resize(Simulation::getBoidCount() + 2);
+		for (unsigned i = 0; i < previousStates.size(); i++) {
+			AICharacter* character = getCharacter(i);
+			previousStates[i].position = character->Position;
+			previousStates[i].orientation = character->Orientation;
+		}
+	}
 	
-	// An action that can change the behaviour of the moon AI
-	class MoonAction : public Action {
-	public:
-		State state;
-		
-		virtual void act() {
-			if (state == Following) {
-				moonBehaviour = seek;
-				Kore::log(Kore::Info, "Moon is now seeking");
+	// Blends a coordinate from the last tick to the current one.
+	// A character that wrapped around the world jumps instead of crossing the whole screen
+	float interpolateCoordinate(float previous, float current, float alpha) {
+		if (Kore::abs(current - previous) > Simulation::worldSize) return current;
+		return previous + (current - previous) * alpha;
+	}
+	
+	// Blends an angle along the shorter way around
+	float interpolateAngle(float previous, float current, float alpha) {
+		float difference = current - previous;
+		while (difference > Kore::pi) difference -= 2.0f * Kore::pi;
+		while (difference < -Kore::pi) difference += 2.0f * Kore::pi;
+		return previous + difference * alpha;
+	}
+	
+	// Copies the state of the AI characters into the model matrices of their meshes.
+	// alpha is how far the frame is between the last tick (0) and the next one (1)
+	void updateTransforms(float alpha) {
+		PROFILE_ZONE("updateTransforms");
+		for (unsigned i = 0; i < previousStates.size(); i++) {
+			AICharacter* character = getCharacter(i);
+			const CharacterState& previous = previousStates[i];
+			float x = interpolateCoordinate(previous.position[0], character->Position[0], alpha);
+			float z = interpolateCoordinate(previous.position[1], character->Position[1], alpha);
+			
+			if (character == Simulation::getMoon()) {
+				character->meshObject->M = mat4::Translation(x, 0.0f, z);
+			}
+			else if (character == Simulation::getEarth()) {
+				character->meshObject->M = mat4::Translation(x, 0.0f, z) * mat4::Scale(2.0f, 2.0f, 2.0f);
 			}
 			else {
-				moonBehaviour = wander;
-				Kore::log(Kore::Info, "Moon is now wandering");
+				float orientation = interpolateAngle(previous.orientation, character->Orientation, alpha);
+				character->meshObject->M = mat4::Translation(x, 0.0f, z) * mat4::RotationY(orientation + Kore::pi);
 			}
 		}
-	};
-	
-	// A state in the moon's state machine. Returns the appropriate MoonAction to switch the state as the entry action
-	class MoonState : public StateMachineState
-	{
-	public:
-		
-		State state;
-		
-		virtual Action* getEntryActions() {
-			MoonAction* changeStatusAction = new MoonAction();
-			changeStatusAction->state = state;
-			changeStatusAction->next = nullptr;
-			return changeStatusAction;
-		}
-		
-		virtual Action* getExitActions() {
-			return new Action();
-		}
-	};
+	}
 	
+	// Sets the camera for the pipeline the render queue has just switched to
+	void setCamera(Graphics4::PipelineState*) {
+		Graphics4::setMatrix(pLocation, P);
+		Graphics4::setMatrix(vLocation, View);
+	}
 	
-	// A transition for the Moon's state machine.
-	// Is realized as a fixed target transition with a condition
-	class MoonTransition :
-	public Transition,
-	public ConditionalTransitionMixin,
-	public FixedTargetTransitionMixin
-	{
-	public:
-		
-		virtual Action* getActions() {
-			return new Action();
+	// P starts recording, pressing it again writes what was recorded to trace.json for chrome://tracing or Perfetto
+	void toggleProfiling() {
+		if (!Profiler::isEnabled()) {
+			Profiler::clear();
+			Profiler::setEnabled(true);
+			Kore::log(Kore::Info, "Profiling started");
 		}
-		
-		virtual bool isTriggered() {
-			bool result = ConditionalTransitionMixin::isTriggered();
-			return result;
-		}
-		
-		StateMachineState* getTargetState()
-		{
-			return FixedTargetTransitionMixin::getTargetState();
-		}
-	};
-	
-	/************************************************************************/
-	// Task P13.2a: Complete this class so that it correctly returns
-	// Checks if the moon is closer or further away from the specified distance
-	/************************************************************************/
-	class MoonCondition : public Condition {
-	public:
-		float transitionDistance;
-		
-		bool checkIfCloser;
-		
-		AICharacter* earthCharacter;
-		
-		AICharacter* moonCharacter;
-		
-		bool lastResult;
-		
-		/**
-		 * Performs the test for this condition.
-		 */
-		virtual bool test() {
-			float distance = earthCharacter->Position.distance(moonCharacter->Position);
-			bool result;
-			
-			if (checkIfCloser) {
-				result = (distance < transitionDistance);
-				if (result != lastResult) {
-					if (checkIfCloser) {
-						Kore::log(Kore::Info, "checkIfCloser TRUE:");
-					}
-					else {
-						Kore::log(Kore::Info, "checkIfCloser FALSE:");
-					}
-					if (result) {
-						Kore::log(Kore::Info, "Moon is closer than distance");
-					}
-					else {
-						Kore::log(Kore::Info, "Moon is further than distance");
-					}
-				}
+		else {
+			// Between frames, so no thread records
+			Profiler::setEnabled(false);
+			if (Profiler::writeChromeTrace("trace.json")) {
+				Kore::log(Kore::Info, "Profile written to trace.json");
 			}
 			else {
-				result = (distance >= transitionDistance);
-				if (result != lastResult) {
-					if (checkIfCloser) {
-						Kore::log(Kore::Info, "checkIfCloser TRUE:");
-					}
-					else {
-						Kore::log(Kore::Info, "checkIfCloser FALSE:");
-					}
-					if (result) {
-						Kore::log(Kore::Info, "Moon is further than distance");
-					}
-					else {
-						Kore::log(Kore::Info, "Moon is closer than distance");
-					}
-				}
+				Kore::log(Kore::Error, "Could not write trace.json");
 			}
-			lastResult = result;
-			return result;
 		}
-	};
+	}
 	
-	// Update the AI
-	void updateAI(float deltaT) {
-		// Update the state machine
-		// Get the actions that should be executed
-		Action* actions = moonStateMachine.update();
-		
-		// Execute any actions that should be executed
-		while (actions != nullptr) {
-			actions->act();
-			actions = actions->next;
-		}
-		
-		
-		// Update the steering behaviours
-		float duration = deltaT;
-		
-		// One steering output is re-used
-		SteeringOutput steer;
-		
-		// Handle the moon
-		moonBehaviour->getSteering(&steer);
-		moon->integrate(steer, 0.95f, duration);
-		moon->trimMaxSpeed(1.0f);
-		
-		// Keep in bounds of the world
-		TrimWorld(moon->Position[0]);
-		TrimWorld(moon->Position[1]);
+	void update() {
+		PROFILE_ZONE("frame");
 		
-		moon->meshObject->M = mat4::Translation(moon->Position[0], 0.0f, moon->Position[1]);
+		// The actions of the last frame have been executed
+		Memory::resetFrame();
 		
-		// Handle the earth - treat player input as a steering output
-		steer.clear();
-		steer.linear = deltaPosition;
-		steer.linear *= 10.0f;
-		earth->integrate(steer, 0.95f, duration);
+		double t = System::time() - startTime;
+		double deltaT = t - lastTime;
+		lastTime = t;
 		
-		earth->trimMaxSpeed(3.0f);
+		if (t - lastUsageLog >= usageLogInterval) {
+			Memory::logUsage();
+			lastUsageLog = t;
+		}
 		
-		// Keep in bounds of the world
-		TrimWorld(earth->Position[0]);
-		TrimWorld(earth->Position[1]);
+		// Update the AI in fixed ticks
+		Simulation::setPlayerInput(deltaPosition);
+		accumulator += deltaT;
+		int ticks = 0;
+		while (accumulator >= fixedDeltaT && ticks < maxTicksPerFrame) {
+			savePreviousStates();
+			Simulation::update(fixedDeltaT);
+			accumulator -= fixedDeltaT;
+			++ticks;
+		}
 		
-		earth->meshObject->M = mat4::Translation(earth->Position[0], 0.0f, earth->Position[1]) * mat4::Scale(2.0f, 2.0f, 2.0f);
+		// Drop the time we could not catch up on
+		if (accumulator >= fixedDeltaT) {
+			accumulator = 0.0;
+		}
 		
-		// Handle the boids
+		updateTransforms((float)(accumulator / fixedDeltaT));
 		
-		for (int i = 0; i < numBoids; i++) {
-			AICharacter* boid = boids[i];
-			
-			// Get the steering output
-			flockSteering->character = boid;
-			flockSteering->getSteering(&steer);
-			
-			// Update the kinematic
-			boid->integrate(steer, 0.7f, duration);
-			
-			// Face the direction we are moving
-			boid->setOrientationFromVelocity();
-			
-			// Check for maximum speed
-			boid->trimMaxSpeed(4.0f);
-			
-			// Keep in bounds of the world
-			TrimWorld(boid->Position[0]);
-			TrimWorld(boid->Position[1]);
-			
-			boid->meshObject->M = mat4::Translation(boid->Position[0], 0.0f, boid->Position[1]) * mat4::RotationY(boid->Orientation + Kore::pi);
+		if (!assetLoader->isDone()) {
+			PROFILE_ZONE("uploadAssets");
+			assetLoader->update(uploadBudget);
 		}
-	}
-	
-	void update() {
-		double t = System::time() - startTime;
-		double deltaT = t - lastTime;
-		lastTime = t;
-		
-		// Update the AI
-		updateAI((float)deltaT);
 		
 		Graphics4::begin();
 		Graphics4::clear(Graphics4::ClearColorFlag | Graphics4::ClearDepthFlag, 0xff9999FF, 1000.0f);
 		
-		Graphics4::setPipeline(pipeline);
-		
 		// set the camera - orthogonal projection
-		float val = worldSize;
+		float val = Simulation::worldSize;
 		P = mat4::orthogonalProjection(-val, val, -val, val, -val, val);
 		View = mat4::RotationX(Kore::pi / 2.0f * 3.0f);
-		Graphics4::setMatrix(pLocation, P);
-		Graphics4::setMatrix(vLocation, View);
-		
 		
-		// iterate the MeshObjects
-		MeshObject** current = &objects[0];
-		while (*current != nullptr) {
-			// set the model matrix
-			Graphics4::setMatrix(mLocation, (*current)->M);
-			
-			(*current)->render(tex);
-			++current;
+		// draw the MeshObjects that are loaded, one call per mesh and texture
+		{
+			PROFILE_ZONE("render");
+			for (unsigned i = 0; i < objects.size(); i++) {
+				MeshObject* object = objects[i];
+				if (object->isReady()) {
+					renderQueue->add(pipeline, tex, object->getTexture(), object->getVertexBuffer(), object->getIndexBuffer(), object->M);
+				}
+			}
+			renderQueue->submit(setCamera);
 		}
 		
 		Graphics4::end();
@@ -349,6 +255,9 @@ namespace {
 		else if (code == KeyDown) {
 			deltaPosition[1] = -movementDelta;
 		}
+		else if (code == KeyP) {
+			toggleProfiling();
+		}
 	}
 	
 	void keyUp(KeyCode code) {
@@ -369,111 +278,18 @@ namespace {
 	}
 	
 	void initAI() {
-		// Set up Earth and moon AI characters
-		Kore::Random::init(42);
-		
-		moon = new AICharacter();
-		moon->Position = vec2(1.0f, 1.0f);
-		moon->meshObject = objects[2];
-		
-		earth = new AICharacter();
-		earth->meshObject = objects[0];
-		
-		// Set up the moon's behaviours
-		wander = new Wander();
-		wander->character = moon;
-		wander->maxAcceleration = 2.0f;
-		wander->turnSpeed = 2.0f;
-		wander->volatility = 20.0f;
-		
-		seek = new Seek();
-		seek->character = moon;
-		seek->maxAcceleration = 3.0f;
-		seek->target = &(earth->Position);
-		
-		moonBehaviour = wander;
-		
-		// Set up the moon's state machine
-		MoonState* wanderState = new MoonState();
-		MoonState* followState = new MoonState();
-		wanderState->state = Wandering;
-		followState->state = Following;
-		
-		MoonTransition* WanderingToFollowing = new MoonTransition();
-		WanderingToFollowing->target = followState;
-		
-		MoonTransition* FollowingToWandering = new MoonTransition();
-		FollowingToWandering->target = wanderState;
-		
-		/************************************************************************/
-		// Task 13.2b: After you have completed the MoonCondition object, instantiate it here
-		/************************************************************************/
-		
-		MoonCondition* ShouldFollow = new MoonCondition();
-		// This condition should trigger if the moon is closer than 1 unit to the Earth
-		ShouldFollow->checkIfCloser = true;
-		ShouldFollow->earthCharacter = earth;
-		ShouldFollow->moonCharacter = moon;
-		ShouldFollow->transitionDistance = 1.0f;
+		Simulation::Settings settings;
+		settings.boidCount = numBoids;
+		Simulation::init(settings);
 		
-		MoonCondition* ShouldWander = new MoonCondition();
-		// This condition should trigger if the moon is further away than 1 unit from the Earth
-		ShouldWander->checkIfCloser = false;
-		ShouldWander->earthCharacter = earth;
-		ShouldWander->moonCharacter = moon;
-		ShouldWander->transitionDistance = 1.0f;
-		
-		
-		
-		
-		WanderingToFollowing->condition = ShouldFollow;
-		FollowingToWandering->condition = ShouldWander;
-		
-		wanderState->firstTransition = WanderingToFollowing;
-		followState->firstTransition = FollowingToWandering;
-		
-		moonStateMachine.initialState = wanderState;
-		moonStateMachine.currentState = wanderState;
-		
-		
-		// Set up the boids
+		// Object 0 is the Earth, 2 the moon and 3++ the boids
+		Simulation::getEarth()->meshObject = objects[0];
+		Simulation::getMoon()->meshObject = objects[2];
 		for (int i = 0; i < numBoids; i++) {
-			boids[i] = new AICharacter();
-			AICharacter* current = boids[i];
-			current->meshObject = objects[3 + i];
-			current->Position[0] = Wander::randomBinomial(worldSize);
-			current->Position[1] = Wander::randomBinomial(worldSize);
-			current->Orientation = Wander::randomReal(Kore::pi);
-			current->Velocity[0] = Wander::randomBinomial(2.0f);
-			current->Velocity[1] = Wander::randomReal(2.0f);
-			current->Rotation = 0.0f;
-			flock.boids.push_back(current);
+			Simulation::getBoid(i)->meshObject = objects[3 + i];
 		}
 		
-		float accel = 2.0f;
-		// Set up the steering behaviours (we use one for all)
-		separation = new Separation;
-		separation->maxAcceleration = accel;
-		separation->neighbourhoodSize = 1.0f;
-		separation->neighbourhoodMinDP = -1.0f;
-		separation->theFlock = &flock;
-		
-		cohesion = new Cohesion;
-		cohesion->maxAcceleration = accel;
-		cohesion->neighbourhoodSize = 1.0f;
-		cohesion->neighbourhoodMinDP = 0.0f;
-		cohesion->theFlock = &flock;
-		
-		vMA = new VelocityMatchAndAlign;
-		vMA->maxAcceleration = accel;
-		vMA->neighbourhoodSize = 2.0f;
-		vMA->neighbourhoodMinDP = 0.0f;
-		vMA->theFlock = &flock;
-		
-		flockSteering = new BlendedSteering();
-		flockSteering->behaviours.push_back(BlendedSteering::BehaviourAndWeight(separation, 0.1f));
-		flockSteering->behaviours.push_back(BlendedSteering::BehaviourAndWeight(cohesion, 1.0f));
-		flockSteering->behaviours.push_back(BlendedSteering::BehaviourAndWeight(vMA, 2.0f));
+		savePreviousStates();
 	}
 	
 	
@@ -489,9 +305,12 @@ namespace {
 		structure.add("tex", Graphics4::Float2VertexData);
 		structure.add("nor", Graphics4::Float3VertexData);
 		
+		renderQueue = new RenderQueue;
+		
 		pipeline = new Graphics4::PipelineState;
 		pipeline->inputLayout[0] = &structure;
-		pipeline->inputLayout[1] = nullptr;
+		pipeline->inputLayout[1] = &renderQueue->getInstanceStructure();
+		pipeline->inputLayout[2] = nullptr;
 		pipeline->vertexShader = vertexShader;
 		pipeline->fragmentShader = fragmentShader;
 		pipeline->depthMode = Graphics4::ZCompareLess;
@@ -501,24 +320,25 @@ namespace {
 		tex = pipeline->getTextureUnit("tex");
 		pLocation = pipeline->getConstantLocation("P");
 		vLocation = pipeline->getConstantLocation("V");
-		mLocation = pipeline->getConstantLocation("M");
+		
+		// The objects show up as soon as their assets are loaded.
+		// Objects with the same files share them, every file is only loaded once.
+		// Only the moon texture does not keep its pixels readable
+		assetLoader = new AssetLoader;
 		
 		// Object 0 is the Earth
-		objects[0] = new MeshObject("Level/ball.obj", "Level/unshaded.png", structure);
+		objects.push_back(new MeshObject(assetLoader, "Level/ball.obj", "Level/unshaded.png", structure, 1.0f, true));
 		
 		// Object 1 is the background
-		objects[1] = new MeshObject("Level/plane.obj", "Level/StarMap.png", structure);
+		objects.push_back(new MeshObject(assetLoader, "Level/plane.obj", "Level/StarMap.png", structure, 1.0f, true));
 		objects[1]->M = mat4::Translation(0.0f, 0.5f, 0.0f);
 		
 		// Object 2 is the Moon
-		Graphics4::Texture* moonTexture = new Graphics4::Texture("Level/moonmap1k.jpg");
-		objects[2] = new MeshObject(objects[0]->getVertexBuffer(), objects[0]->getIndexBuffer(), moonTexture);
+		objects.push_back(new MeshObject(assetLoader, "Level/ball.obj", "Level/moonmap1k.jpg", structure));
 		
 		// Objects 3++ are the boids
-		// Only load once and copy in order to speed up the loading time
-		MeshObject* referenceBoid = new MeshObject("Level/boid.obj", "Level/basicTiles3x3red.png", structure);
 		for (int i = 0; i < numBoids; i++) {
-			objects[3 + i] = new MeshObject(referenceBoid->getVertexBuffer(), referenceBoid->getIndexBuffer(), referenceBoid->getTexture());
+			objects.push_back(new MeshObject(assetLoader, "Level/boid.obj", "Level/basicTiles3x3red.png", structure, 1.0f, true));
 		}
 		
 		// Initialize the AI
@@ -540,6 +360,8 @@ int kore(int argc, char** argv) {
 	
 	startTime = System::time();
 	lastTime = 0.0f;
+	accumulator = 0.0;
+	lastUsageLog = 0.0;
 	
 	Keyboard::the()->KeyDown = keyDown;
 	Keyboard::the()->KeyUp = keyUp;
@@ -551,4 +373,4 @@ int kore(int argc, char** argv) {
 	
 	return 0;
 }
-
+#endif
@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "FlockSoA.h"
+
+#include <cstring>
+
+using namespace Kore;
+
+namespace {
+	const unsigned arrayCount = 6;
+	
+	// Number of floats that fill one alignment unit, capacities are rounded up to this
+	const unsigned floatsPerAlignment = FlockSoA::alignment / sizeof(float);
+}
+
+FlockSoA::FlockSoA()
+:
+positionX(nullptr), positionY(nullptr), velocityX(nullptr), velocityY(nullptr),
+orientation(nullptr), rotation(nullptr), count(0), capacity(0), block(nullptr)
+{}
+
+FlockSoA::~FlockSoA()
+{
+	delete[] block;
+}
+
+void FlockSoA::resize(unsigned newCount)
+{
+	if (newCount > capacity)
+	{
+		unsigned newCapacity = (newCount + floatsPerAlignment - 1) / floatsPerAlignment * floatsPerAlignment;
+		u8* newBlock = new u8[newCapacity * arrayCount * sizeof(float) + alignment];
+		
+		// Align the first array, the others follow at multiples of the alignment
+		float* base = (float*)(((size_t)newBlock + alignment - 1) & ~(size_t)(alignment - 1));
+		memset(base, 0, newCapacity * arrayCount * sizeof(float));
+		
+		float* oldArrays[arrayCount] = { positionX, positionY, velocityX, velocityY, orientation, rotation };
+		float** newArrays[arrayCount] = { &positionX, &positionY, &velocityX, &velocityY, &orientation, &rotation };
+		for (unsigned a = 0; a < arrayCount; ++a)
+		{
+			*newArrays[a] = base + a * newCapacity;
+			if (count) memcpy(*newArrays[a], oldArrays[a], count * sizeof(float));
+		}
+		
+		delete[] block;
+		block = newBlock;
+		capacity = newCapacity;
+	}
+	else if (newCount > count)
+	{
+		float* arrays[arrayCount] = { positionX, positionY, velocityX, velocityY, orientation, rotation };
+		for (unsigned a = 0; a < arrayCount; ++a)
+		{
+			memset(arrays[a] + count, 0, (newCount - count) * sizeof(float));
+		}
+	}
+	count = newCount;
+}
+
+void FlockSoA::load(unsigned index, const AICharacter* character)
+{
+	positionX[index] = character->Position.x();
+	positionY[index] = character->Position.y();
+	velocityX[index] = character->Velocity.x();
+	velocityY[index] = character->Velocity.y();
+	orientation[index] = character->Orientation;
+	rotation[index] = character->Rotation;
+}
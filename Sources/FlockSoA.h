@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Steering.h"
+
+/**
+* A snapshot of the kinematic state of a flock as a structure of
+* arrays.
+*
+* Each component lives in its own contiguous float array that is
+* aligned for vector loads, so that neighbourhood searches stream
+* through memory instead of chasing one pointer per boid. Slot i
+* corresponds to the i-th boid of the flock.
+*
+* The AICharacters stay the real storage, the flock copies them in
+* with load. The steering behaviours and the simulation read and
+* write the fields of AICharacter directly, so owning arrays would
+* need all of them to go through handles. The copy reads every boid
+* once per tick, while the neighbourhood queries, which read every
+* boid once per neighbour, run on the arrays.
+*/
+class FlockSoA
+{
+public:
+	/**
+	* Alignment of every array in bytes.
+	*/
+	static const unsigned alignment = 32;
+
+	float* positionX;
+	float* positionY;
+	float* velocityX;
+	float* velocityY;
+	float* orientation;
+	float* rotation;
+
+	FlockSoA();
+	~FlockSoA();
+
+	/**
+	* Sets the number of slots. Existing slots keep their values,
+	* new slots are zeroed.
+	*/
+	void resize(unsigned count);
+
+	unsigned size() const
+	{
+		return count;
+	}
+
+	/**
+	* Copies the state of the character into the given slot.
+	*/
+	void load(unsigned index, const AICharacter* character);
+
+private:
+	FlockSoA(const FlockSoA&);
+	FlockSoA& operator=(const FlockSoA&);
+
+	unsigned count;
+	unsigned capacity;
+	Kore::u8* block;
+};
@@ -11,19 +11,42 @@
  */
 #include "pch.h"
 #include "Flocking.h"
+#include "Profiler.h"
 #include <cstring>
+#include <algorithm>
+#include <assert.h>
 
 using namespace Kore;
 
 Flock::Flock()
 :
-inNeighbourhood(0), arraySize(0)
+inNeighbourhood(0), arraySize(0), storage(ListStorage), useGrid(false)
 {}
 
-unsigned Flock::prepareNeighourhood(
-									const AICharacter* of,
-									float size,
-									float minDotProduct /* = -1.0 */)
+namespace {
+	bool isInNeighbourhood(const vec2& position, const vec2& ofPosition, const vec2& look, float size, float minDotProduct)
+	{
+		// Check for maximum distance
+		if (position.distance(ofPosition) > size) return false;
+		
+		// Check for angle
+		if (minDotProduct > -1.0)
+		{
+			vec2 offset = position - ofPosition;
+			vec2 offsetNormalized = offset;
+			offsetNormalized = offsetNormalized.normalize();
+			if (look.dot(offsetNormalized) < minDotProduct)
+			{
+				return false;
+			}
+		}
+		
+		// If we get here we've passed all tests
+		return true;
+	}
+}
+
+void Flock::resizeFlags()
 {
 	// Make sure the array is of the correct size
 	if (arraySize != boids.size())
@@ -32,8 +55,135 @@ unsigned Flock::prepareNeighourhood(
 		arraySize = boids.size();
 		if (arraySize) inNeighbourhood = new bool[arraySize];
 		memset(inNeighbourhood, 0, sizeof(bool)*arraySize);
+		neighbourIndices.clear();
+	}
+}
+
+void Flock::refresh()
+{
+	members.assign(boids.begin(), boids.end());
+	if (storage == SoAStorage)
+	{
+		soa.resize(members.size());
+		for (unsigned i = 0; i < members.size(); ++i)
+		{
+			soa.load(i, members[i]);
+		}
+	}
+}
+
+void Flock::buildGrid(float worldSize, float cellSize)
+{
+	refresh();
+	grid.reset(worldSize, cellSize, members.size());
+	for (unsigned i = 0; i < members.size(); ++i)
+	{
+		grid.insert(i, members[i]->Position);
+	}
+	useGrid = true;
+}
+
+void Flock::boidMoved(unsigned index)
+{
+	if (storage == SoAStorage) soa.load(index, members[index]);
+	if (useGrid) grid.move(index, members[index]->Position);
+}
+
+vec2 Flock::positionOf(unsigned index) const
+{
+	if (storage == SoAStorage) return vec2(soa.positionX[index], soa.positionY[index]);
+	return members[index]->Position;
+}
+
+vec2 Flock::velocityOf(unsigned index) const
+{
+	if (storage == SoAStorage) return vec2(soa.velocityX[index], soa.velocityY[index]);
+	return members[index]->Velocity;
+}
+
+float Flock::orientationOf(unsigned index) const
+{
+	if (storage == SoAStorage) return soa.orientation[index];
+	return members[index]->Orientation;
+}
+
+void Flock::gatherCandidates(const vec2& center, float radius, std::vector<unsigned>& result) const
+{
+	if (useGrid)
+	{
+		unsigned first = result.size();
+		grid.query(center, radius, result);
+		std::sort(result.begin() + first, result.end());
+		return;
+	}
+	
+	for (unsigned i = 0; i < members.size(); ++i)
+	{
+		result.push_back(i);
+	}
+}
+
+void Flock::findNeighbours(
+						   const vec2& center,
+						   const vec2& look,
+						   float radius,
+						   float minDotProduct,
+						   NeighbourScratch& scratch,
+						   std::vector<unsigned>& result) const
+{
+	NeighbourQuery query;
+	query.x = center.x();
+	query.y = center.y();
+	query.lookX = look.x();
+	query.lookY = look.y();
+	query.radiusSquared = radius * radius;
+	query.minDotProduct = minDotProduct;
+	query.useCone = minDotProduct > -1.0f;
+	
+	result.clear();
+	
+	// Without a grid the arrays can be searched in place
+	if (storage == SoAStorage && !useGrid)
+	{
+		unsigned count = soa.size();
+		result.resize(count);
+		if (count) result.resize(::findNeighbours(soa.positionX, soa.positionY, count, query, &result[0]));
+		return;
 	}
 	
+	// Otherwise copy the candidates into contiguous arrays first
+	scratch.candidates.clear();
+	gatherCandidates(center, radius, scratch.candidates);
+	unsigned count = scratch.candidates.size();
+	if (count == 0) return;
+	
+	scratch.x.resize(count);
+	scratch.y.resize(count);
+	scratch.hits.resize(count);
+	for (unsigned c = 0; c < count; ++c)
+	{
+		vec2 position = positionOf(scratch.candidates[c]);
+		scratch.x[c] = position.x();
+		scratch.y[c] = position.y();
+	}
+	
+	unsigned found = ::findNeighbours(&scratch.x[0], &scratch.y[0], count, query, &scratch.hits[0]);
+	result.resize(found);
+	for (unsigned h = 0; h < found; ++h)
+	{
+		result[h] = scratch.candidates[scratch.hits[h]];
+	}
+}
+
+
+unsigned Flock::prepareNeighourhood(
+									const AICharacter* of,
+									float size,
+									float minDotProduct /* = -1.0 */)
+{
+	PROFILE_ZONE("Flock::prepareNeighourhood");
+	resizeFlags();
+	
 	// Compile the look vector if we need it
 	vec2 look;
 	if (minDotProduct > -1.0f)
@@ -41,51 +191,92 @@ unsigned Flock::prepareNeighourhood(
 		look = of->getOrientationAsVector();
 	}
 	
-	Flock result;
-	std::list<AICharacter*>::iterator bi;
-	unsigned i = 0, count = 0;;
-	for (bi = boids.begin(); bi != boids.end(); bi++, i++)
+	neighbours.clear();
+	
+	// Only the boids of the last neighbourhood can still be flagged
+	for (unsigned i = 0; i < neighbourIndices.size(); ++i)
 	{
-		AICharacter*k = *bi;
-		inNeighbourhood[i] = false;
+		inNeighbourhood[neighbourIndices[i]] = false;
+	}
+	neighbourIndices.clear();
+	
+	if (storage == SoAStorage)
+	{
+		// The arrays must have been filled by refresh or buildGrid
+		assert(soa.size() == arraySize);
 		
-		// Ignore ourself
-		if (k == of) continue;
+		findNeighbours(of->Position, look, size, minDotProduct, scratch, candidates);
+		for (unsigned c = 0; c < candidates.size(); ++c)
+		{
+			unsigned i = candidates[c];
+			AICharacter* k = members[i];
+			
+			// Ignore ourself
+			if (k == of) continue;
+			
+			inNeighbourhood[i] = true;
+			neighbourIndices.push_back(i);
+			neighbours.push_back(k);
+		}
+		return neighbours.size();
+	}
+	
+	if (useGrid)
+	{
+		candidates.clear();
+		grid.query(of->Position, size, candidates);
 		
-		// Check for maximum distance
-		if (k->Position.distance(of->Position) > size) continue;
+		// Visit the candidates in list order so that the neighbourhood
+		// sums come out exactly as with the brute-force search
+		std::sort(candidates.begin(), candidates.end());
 		
-		// Check for angle
-		if (minDotProduct > -1.0)
+		for (unsigned c = 0; c < candidates.size(); ++c)
 		{
-			vec2 offset = k->Position - of->Position;
-			vec2 offsetNormalized = offset;
-			offsetNormalized = offsetNormalized.normalize();
-			if (look.dot(offsetNormalized) < minDotProduct)
-			{
-				continue;
-			}
+			unsigned i = candidates[c];
+			AICharacter* k = members[i];
+			
+			// Ignore ourself
+			if (k == of) continue;
+			if (!isInNeighbourhood(k->Position, of->Position, look, size, minDotProduct)) continue;
+			
+			inNeighbourhood[i] = true;
+			neighbourIndices.push_back(i);
+			neighbours.push_back(k);
 		}
+		return neighbours.size();
+	}
+	
+	std::list<AICharacter*>::iterator bi;
+	unsigned i = 0;
+	for (bi = boids.begin(); bi != boids.end(); bi++, i++)
+	{
+		AICharacter*k = *bi;
+		inNeighbourhood[i] = k != of && isInNeighbourhood(k->Position, of->Position, look, size, minDotProduct);
+		if (!inNeighbourhood[i]) continue;
 		
-		// If we get here we've passed all tests
-		inNeighbourhood[i] = true;
-		count++;
+		neighbourIndices.push_back(i);
+		neighbours.push_back(k);
 	}
-	return count;
+	return neighbours.size();
 }
 
 vec2 Flock::getNeighbourhoodCenter()
 {
 	vec2 center;
-	std::list<AICharacter*>::iterator bi;
-	unsigned i = 0;
-	unsigned count = 0;
-	for (bi = boids.begin(); bi != boids.end(); bi++, i++)
+	unsigned count = neighbours.size();
+	if (storage == SoAStorage)
 	{
-		if (inNeighbourhood[i])
+		for (unsigned i = 0; i < count; i++)
 		{
-			center += (*bi)->Position;
-			count++;
+			unsigned k = neighbourIndices[i];
+			center += vec2(soa.positionX[k], soa.positionY[k]);
+		}
+	}
+	else
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			center += neighbours[i]->Position;
 		}
 	}
 	center *= 1.0f / (float)count;
@@ -97,15 +288,20 @@ vec2 Flock::getNeighbourhoodCenter()
 vec2 Flock::getNeighbourhoodAverageVelocity()
 {
 	vec2 center;
-	std::list<AICharacter*>::iterator bi;
-	unsigned i = 0;
-	unsigned count = 0;
-	for (bi = boids.begin(); bi != boids.end(); bi++, i++)
+	unsigned count = neighbours.size();
+	if (storage == SoAStorage)
 	{
-		if (inNeighbourhood[i])
+		for (unsigned i = 0; i < count; i++)
 		{
-			center += (*bi)->Velocity;
-			count++;
+			unsigned k = neighbourIndices[i];
+			center += vec2(soa.velocityX[k], soa.velocityY[k]);
+		}
+	}
+	else
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			center += neighbours[i]->Velocity;
 		}
 	}
 	center *= 1.0f / (float)count;
@@ -116,6 +312,9 @@ vec2 Flock::getNeighbourhoodAverageVelocity()
 
 void Separation::getSteering(SteeringOutput* output)
 {
+	// An empty neighbourhood does not steer
+	output->clear();
+	
 	// Get the neighbourhood of boids
 	unsigned count = theFlock->prepareNeighourhood(character, neighbourhoodSize, neighbourhoodMinDP);
 	if (count <= 0) return;
@@ -134,6 +333,9 @@ void Separation::getSteering(SteeringOutput* output)
 
 void Cohesion::getSteering(SteeringOutput* output)
 {
+	// An empty neighbourhood does not steer
+	output->clear();
+	
 	// Get the neighbourhood of boids
 	unsigned count = theFlock->prepareNeighourhood(character, neighbourhoodSize, neighbourhoodMinDP);
 	if (count <= 0) return;
@@ -151,6 +353,9 @@ void Cohesion::getSteering(SteeringOutput* output)
 
 void VelocityMatchAndAlign::getSteering(SteeringOutput* output)
 {
+	// An empty neighbourhood does not steer
+	output->clear();
+	
 	// Get the neighbourhood of boids
 	unsigned count = theFlock->prepareNeighourhood(character, neighbourhoodSize, neighbourhoodMinDP);
 	if (count <= 0) return;
@@ -166,3 +371,142 @@ void VelocityMatchAndAlign::getSteering(SteeringOutput* output)
 		output->linear *= maxAcceleration;
 	}
 }
+
+
+void FlockingSteering::getSteering(SteeringOutput* output)
+{
+	blend(character, character->Position, character->Velocity, character->getOrientationAsVector(), scratch, candidates, output);
+}
+
+void FlockingSteering::getSteering(
+								  unsigned index,
+								  NeighbourScratch& scratch,
+								  std::vector<unsigned>& candidates,
+								  SteeringOutput* output) const
+{
+	float orientation = theFlock->orientationOf(index);
+	vec2 look(Kore::sin(orientation), Kore::cos(orientation));
+	blend(theFlock->boidAt(index), theFlock->positionOf(index), theFlock->velocityOf(index), look, scratch, candidates, output);
+}
+
+void FlockingSteering::blend(
+							 const AICharacter* self,
+							 const vec2& position,
+							 const vec2& velocity,
+							 const vec2& look,
+							 NeighbourScratch& scratch,
+							 std::vector<unsigned>& candidates,
+							 SteeringOutput* output) const
+{
+	// Clear the output to start with
+	output->clear();
+	
+	const float separationSize = separation->neighbourhoodSize;
+	const float cohesionSize = cohesion->neighbourhoodSize;
+	const float velocityMatchSize = velocityMatch->neighbourhoodSize;
+	const float separationMinDP = separation->neighbourhoodMinDP;
+	const float cohesionMinDP = cohesion->neighbourhoodMinDP;
+	const float velocityMatchMinDP = velocityMatch->neighbourhoodMinDP;
+	
+	float searchSize = separationSize;
+	if (cohesionSize > searchSize) searchSize = cohesionSize;
+	if (velocityMatchSize > searchSize) searchSize = velocityMatchSize;
+	
+	theFlock->findNeighbours(position, look, searchSize, -1.0f, scratch, candidates);
+	
+	const float separationSizeSquared = separationSize * separationSize;
+	const float cohesionSizeSquared = cohesionSize * cohesionSize;
+	const float velocityMatchSizeSquared = velocityMatchSize * velocityMatchSize;
+	
+	// Accumulate all three neighbourhoods in one pass
+	vec2 separationCenter, cohesionCenter, averageVelocity;
+	unsigned separationCount = 0, cohesionCount = 0, velocityMatchCount = 0;
+	
+	for (unsigned c = 0; c < candidates.size(); ++c)
+	{
+		unsigned i = candidates[c];
+		
+		// Ignore ourself
+		if (theFlock->boidAt(i) == self) continue;
+		
+		vec2 other = theFlock->positionOf(i);
+		float dx = other.x() - position.x();
+		float dy = other.y() - position.y();
+		float distanceSquared = dx * dx + dy * dy;
+		float dotProduct = look.x() * dx + look.y() * dy;
+		
+		if (distanceSquared <= separationSizeSquared && (separationMinDP <= -1.0f || insideViewCone(dotProduct, distanceSquared, separationMinDP)))
+		{
+			separationCenter += other;
+			separationCount++;
+		}
+		if (distanceSquared <= cohesionSizeSquared && (cohesionMinDP <= -1.0f || insideViewCone(dotProduct, distanceSquared, cohesionMinDP)))
+		{
+			cohesionCenter += other;
+			cohesionCount++;
+		}
+		if (distanceSquared <= velocityMatchSizeSquared && (velocityMatchMinDP <= -1.0f || insideViewCone(dotProduct, distanceSquared, velocityMatchMinDP)))
+		{
+			averageVelocity += theFlock->velocityOf(i);
+			velocityMatchCount++;
+		}
+	}
+	
+	// Work out each behaviour as Separation, Cohesion and VelocityMatchAndAlign do
+	SteeringOutput temp;
+	
+	temp.clear();
+	if (separationCount > 0)
+	{
+		separationCenter *= 1.0f / (float)separationCount;
+		
+		// Steer away from the center of mass, like Flee
+		temp.linear = separationCenter - position;
+		if (temp.linear.getLength() > 0)
+		{
+			temp.linear = temp.linear.normalize();
+			temp.linear *= separation->maxAcceleration;
+		}
+		temp.linear *= -1.0f;
+	}
+	output->linear += temp.linear * separationWeight;
+	
+	temp.clear();
+	if (cohesionCount > 0)
+	{
+		cohesionCenter *= 1.0f / (float)cohesionCount;
+		
+		// Steer towards the center of mass, like Seek
+		temp.linear = cohesionCenter - position;
+		if (temp.linear.getLength() > 0)
+		{
+			temp.linear = temp.linear.normalize();
+			temp.linear *= cohesion->maxAcceleration;
+		}
+	}
+	output->linear += temp.linear * cohesionWeight;
+	
+	temp.clear();
+	if (velocityMatchCount > 0)
+	{
+		averageVelocity *= 1.0f / (float)velocityMatchCount;
+		
+		// Try to match the average velocity
+		temp.linear = averageVelocity - velocity;
+		if (temp.linear.getLength() > velocityMatch->maxAcceleration)
+		{
+			temp.linear = temp.linear.normalize();
+			temp.linear *= velocityMatch->maxAcceleration;
+		}
+	}
+	output->linear += temp.linear * velocityMatchWeight;
+	
+	// Divide the accumulated output by the total weight
+	float totalWeight = separationWeight + cohesionWeight + velocityMatchWeight;
+	if (totalWeight > 0.0)
+	{
+		totalWeight = 1.0f / totalWeight;
+		output->linear *= totalWeight;
+		output->angular *= totalWeight;
+	}
+}
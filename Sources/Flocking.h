@@ -15,23 +15,66 @@
 */
 
 #include "Steering.h"
+#include "SpatialGrid.h"
+#include "FlockSoA.h"
+#include "NeighbourKernel.h"
 
 
 #include <list>
+#include <vector>
 
 
 
 
+/**
+* Scratch memory for neighbourhood searches. Every thread that
+* searches a flock needs its own.
+*/
+struct NeighbourScratch
+{
+	std::vector<unsigned> candidates;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<unsigned> hits;
+};
+
 /**
 * This class stores a flock of creatures.
 */
 class Flock
 {
 public:
+	/**
+	* Where neighbourhood queries read the boid state from.
+	*
+	* ListStorage reads each AICharacter through the boids list.
+	* SoAStorage reads a structure of arrays copy (see FlockSoA)
+	* that is refreshed by buildGrid and boidMoved.
+	*/
+	enum Storage
+	{
+		ListStorage,
+		SoAStorage
+	};
+
 	std::list<AICharacter*> boids;
 	bool *inNeighbourhood;
 	unsigned arraySize;
 
+	Storage storage;
+
+	/**
+	* The structure of arrays copy of the boids, slot i holds the
+	* i-th boid of the list. Only used with SoAStorage.
+	*/
+	FlockSoA soa;
+
+	/**
+	* The boids found by the last call to prepareNeighourhood, in
+	* the order in which they appear in the boids list.
+	*/
+	std::vector<AICharacter*> neighbours;
+
 	Flock();
 
 	/**
@@ -43,6 +86,30 @@ public:
 		float minDotProduct = -1.0
 		);
 
+	/**
+	* Takes a snapshot of the boids list for random access and, with
+	* SoAStorage, copies the boid state into the arrays. Called by
+	* buildGrid; call it directly once per tick when no grid is used.
+	*/
+	void refresh();
+
+	/**
+	* Rebuilds the spatial grid from the current boid positions. Once
+	* built, prepareNeighourhood only looks at the grid cells close
+	* to the boid instead of the whole flock. The cell size should be
+	* at least the largest neighbourhood size that will be queried.
+	*
+	* Call this once per tick, before the boids are updated.
+	*/
+	void buildGrid(float worldSize, float cellSize);
+
+	/**
+	* Tells the grid and the SoA storage that the boid with the given
+	* index (its position in the boids list) has moved. This keeps
+	* neighbourhood queries exact while the flock is updated in place.
+	*/
+	void boidMoved(unsigned index);
+
 	/**
 	* Returns the geometric center of the flock.
 	*/
@@ -52,6 +119,73 @@ public:
 	* Returns the average velocity of the flock.
 	*/
 	Kore::vec2 getNeighbourhoodAverageVelocity();
+
+	/**
+	* Appends the indices of all boids that may lie within the
+	* radius around the center to the result, in ascending order.
+	* Without a grid this is every boid. Requires refresh or
+	* buildGrid to have been called this tick.
+	*/
+	void gatherCandidates(const Kore::vec2& center, float radius, std::vector<unsigned>& result) const;
+
+	/**
+	* Finds the boids within the radius around the center and, if
+	* minDotProduct > -1, inside the view cone around look. Uses the
+	* vectorized kernel from NeighbourKernel.h, so distances are
+	* compared squared and the cone is tested without normalizing.
+	* Writes the ascending indices of the boids into result. A boid
+	* sitting at the center is included, callers skip themselves.
+	* Requires refresh or buildGrid to have been called this tick.
+	*/
+	void findNeighbours(
+		const Kore::vec2& center,
+		const Kore::vec2& look,
+		float radius,
+		float minDotProduct,
+		NeighbourScratch& scratch,
+		std::vector<unsigned>& result
+		) const;
+
+	/**
+	* Returns the boid with the given index, valid since the last
+	* refresh.
+	*/
+	AICharacter* boidAt(unsigned index) const
+	{
+		return members[index];
+	}
+
+	/**
+	* Returns the position of the boid with the given index, read
+	* from the current storage.
+	*/
+	Kore::vec2 positionOf(unsigned index) const;
+
+	/**
+	* Returns the velocity of the boid with the given index, read
+	* from the current storage.
+	*/
+	Kore::vec2 velocityOf(unsigned index) const;
+
+	/**
+	* Returns the orientation of the boid with the given index, read
+	* from the current storage.
+	*/
+	float orientationOf(unsigned index) const;
+
+private:
+	void resizeFlags();
+
+	bool useGrid;
+	SpatialGrid grid;
+
+	// Random access to the boids list, valid since the last refresh
+	std::vector<AICharacter*> members;
+
+	// Scratch lists for the queries
+	std::vector<unsigned> candidates;
+	std::vector<unsigned> neighbourIndices;
+	NeighbourScratch scratch;
 };
 
 class BoidSteeringBehaviour : public SteeringBehaviour
@@ -85,4 +219,59 @@ public:
 	virtual void getSteering(SteeringOutput* output);
 };
 
+/**
+* Computes the same weighted blend as a BlendedSteering of a
+* Separation, a Cohesion and a VelocityMatchAndAlign behaviour, but
+* visits every candidate neighbour only once and does all three
+* neighbourhood tests and sums in that single pass.
+*
+* The three behaviours are only used for their settings
+* (neighbourhoodSize, neighbourhoodMinDP and maxAcceleration), the
+* flock is taken from theFlock.
+*/
+class FlockingSteering : public SteeringBehaviour
+{
+public:
+	Flock *theFlock;
+
+	Separation *separation;
+	float separationWeight;
+
+	Cohesion *cohesion;
+	float cohesionWeight;
+
+	VelocityMatchAndAlign *velocityMatch;
+	float velocityMatchWeight;
+
+	virtual void getSteering(SteeringOutput* output);
+
+	/**
+	* Works out the steering for the boid with the given index from
+	* the state stored in theFlock rather than from character. This
+	* does not modify the behaviour, so it can be called from several
+	* threads at once as long as each one passes its own scratch
+	* memory and nobody writes to the flock's storage meanwhile.
+	*/
+	void getSteering(
+		unsigned index,
+		NeighbourScratch& scratch,
+		std::vector<unsigned>& candidates,
+		SteeringOutput* output
+		) const;
+
+private:
+	void blend(
+		const AICharacter* self,
+		const Kore::vec2& position,
+		const Kore::vec2& velocity,
+		const Kore::vec2& look,
+		NeighbourScratch& scratch,
+		std::vector<unsigned>& candidates,
+		SteeringOutput* output
+		) const;
+
+	NeighbourScratch scratch;
+	std::vector<unsigned> candidates;
+};
+
 
@@ -0,0 +1,156 @@
+#include "pch.h"
+
+// Runs the AI without a window or a graphics context and reports how fast it is.
+// Build with the environment variable EXERCISE_HEADLESS set, e.g. for build servers without a display.
+// Usage: Exercise13 [--ticks=N] [--dt=seconds] [--boids=N] [--seed=N] [--threads=N] [--deterministic] [--state-machine=object|batched|compiled] [--trace=trace.json]
+#ifdef EXERCISE_HEADLESS
+
+#include <Kore/Log.h>
+
+#include "Memory.h"
+#include "Simulation.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+	struct Options {
+		unsigned ticks;
+		float deltaT;
+		Simulation::Settings settings;
+		// Where to write a Chrome trace of the run, nullptr for none
+		const char* traceFile;
+	};
+
+	// Indexed by Simulation::MachineKind
+	const char* machineNames[] = { "object", "batched", "compiled" };
+
+	// Returns the value of argument if it starts with name, otherwise nullptr
+	const char* optionValue(const char* argument, const char* name) {
+		size_t length = strlen(name);
+		if (strncmp(argument, name, length) == 0) return argument + length;
+		return nullptr;
+	}
+
+	bool parseMachine(const char* name, Simulation::MachineKind& machine) {
+		for (int kind = 0; kind < (int)(sizeof(machineNames) / sizeof(machineNames[0])); kind++) {
+			if (strcmp(name, machineNames[kind]) == 0) {
+				machine = (Simulation::MachineKind)kind;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parseOptions(int argc, char** argv, Options& options) {
+		options.ticks = 1000;
+		options.deltaT = 1.0f / 60.0f;
+		options.traceFile = nullptr;
+
+		for (int i = 1; i < argc; i++) {
+			const char* value;
+			if ((value = optionValue(argv[i], "--ticks=")) != nullptr) options.ticks = (unsigned)strtoul(value, nullptr, 10);
+			else if ((value = optionValue(argv[i], "--dt=")) != nullptr) options.deltaT = (float)strtod(value, nullptr);
+			else if ((value = optionValue(argv[i], "--boids=")) != nullptr) options.settings.boidCount = (unsigned)strtoul(value, nullptr, 10);
+			else if ((value = optionValue(argv[i], "--seed=")) != nullptr) options.settings.seed = atoi(value);
+			else if ((value = optionValue(argv[i], "--threads=")) != nullptr) options.settings.threadCount = (unsigned)strtoul(value, nullptr, 10);
+			else if ((value = optionValue(argv[i], "--trace=")) != nullptr) options.traceFile = value;
+			else if (strcmp(argv[i], "--deterministic") == 0) options.settings.deterministic = true;
+			else if ((value = optionValue(argv[i], "--state-machine=")) != nullptr) {
+				if (!parseMachine(value, options.settings.moonMachine)) {
+					Kore::log(Kore::Error, "Unknown state machine %s", value);
+					return false;
+				}
+			}
+			else {
+				Kore::log(Kore::Error, "Unknown option %s", argv[i]);
+				return false;
+			}
+		}
+
+		if (options.ticks == 0 || options.deltaT <= 0.0f) {
+			Kore::log(Kore::Error, "--ticks and --dt have to be larger than 0");
+			return false;
+		}
+		return true;
+	}
+
+	// The largest resident set of the process so far in bytes
+	size_t peakMemory() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PeakWorkingSetSize;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+		return (size_t)usage.ru_maxrss;
+#else
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+	}
+
+	// Hash of the positions and velocities of all characters, identical for identical runs
+	unsigned checksum() {
+		unsigned hash = 2166136261u;
+		unsigned count = Simulation::getBoidCount();
+		for (unsigned i = 0; i < count + 2; i++) {
+			AICharacter* character = i < count ? Simulation::getBoid(i) : i == count ? Simulation::getMoon() : Simulation::getEarth();
+			float values[] = { character->Position[0], character->Position[1], character->Velocity[0], character->Velocity[1] };
+			const unsigned char* bytes = (const unsigned char*)values;
+			for (size_t byte = 0; byte < sizeof(values); byte++) {
+				hash = (hash ^ bytes[byte]) * 16777619u;
+			}
+		}
+		return hash;
+	}
+}
+
+int kore(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) return 1;
+
+	Memory::init();
+	Simulation::init(options.settings);
+	Profiler::setEnabled(options.traceFile != nullptr);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (unsigned tick = 0; tick < options.ticks; tick++) {
+		Memory::resetFrame();
+		Simulation::update(options.deltaT);
+	}
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	double agents = Simulation::getBoidCount() + 2.0;
+	double ticksPerSecond = options.ticks / seconds;
+	double nsPerAgentTick = seconds * 1e9 / (options.ticks * agents);
+
+	Kore::log(Kore::Info, "boids=%u seed=%d threads=%u deterministic=%d state_machine=%s ticks=%u dt=%f", options.settings.boidCount, options.settings.seed, options.settings.threadCount, options.settings.deterministic ? 1 : 0, machineNames[options.settings.moonMachine], options.ticks, options.deltaT);
+	Kore::log(Kore::Info, "ticks_per_second=%.1f ns_per_agent_tick=%.1f peak_memory_bytes=%zu checksum=%08x", ticksPerSecond, nsPerAgentTick, peakMemory(), checksum());
+	Memory::logUsage();
+
+	if (options.traceFile != nullptr) {
+		Profiler::setEnabled(false);
+		if (!Profiler::writeChromeTrace(options.traceFile)) {
+			Kore::log(Kore::Error, "Could not write %s", options.traceFile);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif
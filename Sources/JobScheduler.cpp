@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "JobScheduler.h"
+
+#include <assert.h>
+
+JobScheduler::JobScheduler(unsigned workerCount)
+:
+deterministic(false), workerCount(workerCount), owner(std::this_thread::get_id()), queuedJobs(0), quit(false), pendingJobs(0)
+{
+	if (this->workerCount == 0) this->workerCount = std::thread::hardware_concurrency();
+	if (this->workerCount == 0) this->workerCount = 1;
+	
+	for (unsigned worker = 0; worker < this->workerCount; ++worker)
+	{
+		queues.push_back(new WorkQueue);
+	}
+	for (unsigned worker = 1; worker < this->workerCount; ++worker)
+	{
+		threads.push_back(std::thread(&JobScheduler::workerLoop, this, worker));
+	}
+}
+
+JobScheduler::~JobScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wakeUp.notify_all();
+	for (unsigned i = 0; i < threads.size(); ++i)
+	{
+		threads[i].join();
+	}
+	
+	for (unsigned i = 0; i < queues.size(); ++i) delete queues[i];
+	for (unsigned i = 0; i < frameJobs.size(); ++i) delete frameJobs[i];
+	for (unsigned i = 0; i < freeJobs.size(); ++i) delete freeJobs[i];
+}
+
+Job* JobScheduler::allocateJob()
+{
+	Job* job;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		if (freeJobs.empty())
+		{
+			job = new Job;
+		}
+		else
+		{
+			job = freeJobs.back();
+			freeJobs.pop_back();
+		}
+		frameJobs.push_back(job);
+	}
+	
+	job->function = nullptr;
+	job->range = nullptr;
+	job->data = nullptr;
+	job->begin = 0;
+	job->end = 0;
+	job->batchSize = 1;
+	job->parent = nullptr;
+	job->unfinished = 1;
+	job->blockers = 1;
+	job->dependents.clear();
+	return job;
+}
+
+Job* JobScheduler::createJob(JobFunction function, void* data)
+{
+	Job* job = allocateJob();
+	job->function = function;
+	job->data = data;
+	return job;
+}
+
+Job* JobScheduler::createParallelFor(unsigned count, unsigned batchSize, RangeFunction function, void* data)
+{
+	Job* job = allocateJob();
+	job->range = function;
+	job->data = data;
+	job->end = count;
+	job->batchSize = batchSize > 0 ? batchSize : 1;
+	return job;
+}
+
+void JobScheduler::addDependency(Job* before, Job* after)
+{
+	before->dependents.push_back(after);
+	++after->blockers;
+}
+
+void JobScheduler::submit(Job* job)
+{
+	++pendingJobs;
+	if (--job->blockers == 0) push(job, 0);
+}
+
+void JobScheduler::push(Job* job, unsigned worker)
+{
+	WorkQueue* queue = queues[worker];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->jobs.push_back(job);
+		++queuedJobs;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wakeUp.notify_one();
+}
+
+Job* JobScheduler::pop(unsigned worker)
+{
+	WorkQueue* queue = queues[worker];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->jobs.empty()) return nullptr;
+	Job* job = queue->jobs.back();
+	queue->jobs.pop_back();
+	--queuedJobs;
+	return job;
+}
+
+Job* JobScheduler::steal(unsigned worker)
+{
+	WorkQueue* queue = queues[worker];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->jobs.empty()) return nullptr;
+	Job* job = queue->jobs.front();
+	queue->jobs.pop_front();
+	--queuedJobs;
+	return job;
+}
+
+Job* JobScheduler::findWork(unsigned worker)
+{
+	// Newest own job first, it is the most likely to still be in the cache
+	Job* job = pop(worker);
+	if (job) return job;
+	
+	// Then the oldest job of the others, which tends to be the largest chunk of work
+	for (unsigned i = 1; i < workerCount; ++i)
+	{
+		job = steal((worker + i) % workerCount);
+		if (job) return job;
+	}
+	return nullptr;
+}
+
+void JobScheduler::execute(Job* job, unsigned worker)
+{
+	if (job->function)
+	{
+		job->function(job->data);
+	}
+	else if (job->parent != nullptr || job->end - job->begin <= job->batchSize)
+	{
+		// A batch, or a parallel for that is too small to split
+		job->range(job->begin, job->end, worker, job->data);
+	}
+	else
+	{
+		// Split the parallel for into batches, the others steal them from here
+		for (unsigned begin = job->begin; begin < job->end; begin += job->batchSize)
+		{
+			Job* batch = allocateJob();
+			batch->range = job->range;
+			batch->data = job->data;
+			batch->begin = begin;
+			batch->end = job->end - begin > job->batchSize ? begin + job->batchSize : job->end;
+			batch->parent = job;
+			batch->blockers = 0;
+			++job->unfinished;
+			++pendingJobs;
+			push(batch, worker);
+		}
+	}
+	finish(job, worker);
+}
+
+void JobScheduler::finish(Job* job, unsigned worker)
+{
+	if (--job->unfinished != 0) return;
+	
+	for (unsigned i = 0; i < job->dependents.size(); ++i)
+	{
+		Job* dependent = job->dependents[i];
+		if (--dependent->blockers == 0) push(dependent, worker);
+	}
+	if (job->parent != nullptr) finish(job->parent, worker);
+	
+	--pendingJobs;
+}
+
+void JobScheduler::workerLoop(unsigned worker)
+{
+	for (;;)
+	{
+		Job* job = deterministic ? nullptr : findWork(worker);
+		if (job)
+		{
+			execute(job, worker);
+			continue;
+		}
+		
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeUp.wait(lock, [&] { return quit || (!deterministic && queuedJobs > 0); });
+		if (quit) return;
+	}
+}
+
+void JobScheduler::runUntil(const std::atomic<int>& unfinished)
+{
+	while (unfinished > 0)
+	{
+		Job* job = deterministic ? pop(0) : findWork(0);
+		if (job) execute(job, 0);
+		else std::this_thread::yield();
+	}
+}
+
+void JobScheduler::releaseJobs()
+{
+	std::lock_guard<std::mutex> lock(jobMutex);
+	freeJobs.insert(freeJobs.end(), frameJobs.begin(), frameJobs.end());
+	frameJobs.clear();
+}
+
+void JobScheduler::waitAll()
+{
+	assert(std::this_thread::get_id() == owner);
+	runUntil(pendingJobs);
+	
+	// Every job is done, so nobody touches them anymore
+	releaseJobs();
+}
+
+void JobScheduler::parallelFor(unsigned count, unsigned batchSize, RangeFunction function, void* data)
+{
+	// The calling thread works as worker 0 and the jobs are only released by the owner
+	assert(std::this_thread::get_id() == owner);
+	if (count == 0) return;
+	
+	Job* job = createParallelFor(count, batchSize, function, data);
+	submit(job);
+	runUntil(job->unfinished);
+	
+	// Release the jobs unless others are still running or were created and not submitted yet, otherwise waitAll does it later.
+	// Once pendingJobs is 0 no worker touches a job anymore
+	if (pendingJobs > 0) return;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		for (unsigned i = 0; i < frameJobs.size(); ++i)
+		{
+			if (frameJobs[i]->unfinished > 0) return;
+		}
+	}
+	releaseJobs();
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobScheduler;
+
+/**
+* A unit of work for the JobScheduler. Jobs are created by the
+* scheduler and stay valid until the next call to waitAll or to a
+* parallelFor that finds no other job in flight.
+*/
+struct Job
+{
+	friend class JobScheduler;
+
+private:
+	void (*function)(void* data);
+	void (*range)(unsigned begin, unsigned end, unsigned worker, void* data);
+	void* data;
+	unsigned begin;
+	unsigned end;
+	unsigned batchSize;
+
+	// The job that is only finished when this one is, used for the batches of a parallel for
+	Job* parent;
+
+	// The job itself plus its unfinished batches
+	std::atomic<int> unfinished;
+
+	// Unfinished dependencies plus one until the job is submitted
+	std::atomic<int> blockers;
+
+	// Jobs that wait for this one
+	std::vector<Job*> dependents;
+};
+
+/**
+* A small work-stealing job scheduler.
+*
+* Every worker thread has its own queue. It runs the jobs from the
+* back of its own queue and, when that is empty, steals from the
+* front of the others. Jobs can depend on other jobs, and a parallel
+* for splits into batches when it runs, so the batches spread over
+* the workers by stealing.
+*
+* Usage per frame: create the jobs, add the dependencies, submit
+* them and call waitAll. waitAll is the frame barrier: the calling
+* thread helps with the work until every submitted job is done and
+* then releases the jobs.
+*
+* The thread that created the scheduler owns it. It is worker 0 and
+* the only thread that may create and submit jobs, call waitAll or
+* call parallelFor.
+*/
+class JobScheduler
+{
+public:
+	typedef void (*JobFunction)(void* data);
+
+	/**
+	* Processes the items [begin, end). worker is the index of the
+	* executing thread, in [0, getWorkerCount()), e.g. for picking
+	* per-worker scratch memory. The thread calling waitAll or
+	* parallelFor is worker 0.
+	*/
+	typedef void (*RangeFunction)(unsigned begin, unsigned end, unsigned worker, void* data);
+
+	/**
+	* Creates a scheduler with the given number of workers including
+	* the calling thread. 0 uses one worker per hardware thread.
+	*/
+	explicit JobScheduler(unsigned workerCount = 0);
+	~JobScheduler();
+
+	unsigned getWorkerCount() const
+	{
+		return workerCount;
+	}
+
+	/**
+	* When set, all jobs run on the thread that calls waitAll, one
+	* after the other in an order that only depends on how the jobs
+	* were submitted. This makes every run reproducible, even for jobs
+	* that share state.
+	*/
+	std::atomic<bool> deterministic;
+
+	/**
+	* Creates a job that calls function(data).
+	*/
+	Job* createJob(JobFunction function, void* data);
+
+	/**
+	* Creates a job that calls function for batches of at most
+	* batchSize items of [0, count). The job counts as finished when
+	* all batches are.
+	*/
+	Job* createParallelFor(unsigned count, unsigned batchSize, RangeFunction function, void* data);
+
+	/**
+	* Makes after wait for before. Add all dependencies of a job
+	* before submitting it or the job it depends on.
+	*/
+	void addDependency(Job* before, Job* after);
+
+	/**
+	* Hands the job to the workers. It runs as soon as all of its
+	* dependencies have finished.
+	*/
+	void submit(Job* job);
+
+	/**
+	* Works on the submitted jobs until all of them are finished, then
+	* releases every job created since the last call.
+	*/
+	void waitAll();
+
+	/**
+	* Runs a parallel for and waits until it is finished. Other
+	* submitted jobs keep running and are not waited for, although the
+	* calling thread may help with them meanwhile. Only the owning
+	* thread may call it.
+	*/
+	void parallelFor(unsigned count, unsigned batchSize, RangeFunction function, void* data);
+
+private:
+	JobScheduler(const JobScheduler&);
+	JobScheduler& operator=(const JobScheduler&);
+
+	// A queue of runnable jobs that belongs to one worker
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job*> jobs;
+	};
+
+	Job* allocateJob();
+	void push(Job* job, unsigned worker);
+	Job* pop(unsigned worker);
+	Job* steal(unsigned worker);
+	Job* findWork(unsigned worker);
+	void execute(Job* job, unsigned worker);
+	void finish(Job* job, unsigned worker);
+	void workerLoop(unsigned worker);
+	void runUntil(const std::atomic<int>& unfinished);
+	void releaseJobs();
+
+	unsigned workerCount;
+	std::thread::id owner;
+	std::vector<std::thread> threads;
+	std::vector<WorkQueue*> queues;
+
+	// Wakes sleeping workers when jobs are queued
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;
+	std::atomic<int> queuedJobs;
+	bool quit;
+
+	// Submitted jobs that have not finished yet
+	std::atomic<int> pendingJobs;
+
+	// Jobs of the current frame and released jobs for reuse
+	std::mutex jobMutex;
+	std::vector<Job*> frameJobs;
+	std::vector<Job*> freeJobs;
+};
@@ -2,30 +2,322 @@
 
 #include "Memory.h"
 
+#include <Kore/Log.h>
+
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 using namespace Kore;
 
+struct Memory::Arena::Block {
+	Block* next;
+	size_t size;
+	size_t used;
+
+	u8* data() {
+		return (u8*)(this + 1);
+	}
+
+	// Returns null if the block is too full
+	void* allocate(size_t count, size_t alignment) {
+		uintptr_t start = (uintptr_t)data();
+		uintptr_t aligned = (start + used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		size_t end = aligned - start + count;
+		if (end > size) return nullptr;
+		used = end;
+		return (void*)aligned;
+	}
+};
+
 namespace {
-	const size_t memorySize = 10 * 1024 * 1024;
-	const size_t scratchPadSize = 4 * 1024 * 1024;
-	u8* memory;
-	size_t index;
+	const size_t frameAlignment = 16;
+	
+	// Written behind every scratch allocation in debug builds
+	const size_t guardSize = 16;
+	const u8 guardByte = 0xfd;
+
+	// New blocks of the arenas, they grow by at least this much
+	const size_t permanentBlockSize = 4 * 1024 * 1024;
+	const size_t levelBlockSize = 4 * 1024 * 1024;
+	const size_t frameBlockSize = 256 * 1024;
+	const size_t scratchBlockSize = 4 * 1024 * 1024;
+
+	const char* tagNames[Memory::TagCount] = { "other", "meshes", "AI", "actions", "scratch" };
+	
+	struct TagCounters {
+		std::atomic<size_t> liveBytes;
+		std::atomic<size_t> peakBytes;
+		std::atomic<size_t> allocations;
+	};
+	TagCounters counters[Memory::TagCount];
+	
+	// Shared by all threads, so allocating locks
+	Memory::Arena permanent(permanentBlockSize);
+	std::mutex permanentMutex;
+	Memory::Arena level(levelBlockSize);
+	std::mutex levelMutex;
+	
+	// Bytes per tag in the level arena, released by resetLevel
+	size_t levelBytes[Memory::TagCount];
+
+	struct ThreadArenas;
+	
+	// The arenas of all threads, for resetFrame and the scratch report
+	std::vector<ThreadArenas*> threadArenas;
+	std::mutex threadArenasMutex;
+
+	// Every thread allocates frame and scratch memory from its own arenas without locking
+	struct ThreadArenas {
+		ThreadArenas() : frame(frameBlockSize) {
+			std::lock_guard<std::mutex> lock(threadArenasMutex);
+			threadArenas.push_back(this);
+		}
+
+		~ThreadArenas() {
+			std::lock_guard<std::mutex> lock(threadArenasMutex);
+			threadArenas.erase(std::find(threadArenas.begin(), threadArenas.end(), this));
+		}
+
+		Memory::Arena frame;
+		Memory::ScratchStack scratch;
+		
+		// Bytes per tag in the frame arena, only written by the thread itself, released by resetFrame
+		size_t frameBytes[Memory::TagCount] = {};
+	};
+
+	ThreadArenas& getThreadArenas() {
+		thread_local ThreadArenas arenas;
+		return arenas;
+	}
+}
+
+Memory::Arena::Arena(size_t blockSize) : first(nullptr), current(nullptr), blockSize(blockSize) {}
+
+Memory::Arena::~Arena() {
+	while (first != nullptr) {
+		Block* next = first->next;
+		free(first);
+		first = next;
+	}
+}
+
+void* Memory::Arena::allocate(size_t size, size_t alignment) {
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	if (current != nullptr) {
+		void* data = current->allocate(size, alignment);
+		if (data != nullptr) return data;
+
+		// Blocks behind the current one are left from before a rewind and free again
+		while (current->next != nullptr) {
+			current = current->next;
+			current->used = 0;
+			data = current->allocate(size, alignment);
+			if (data != nullptr) return data;
+		}
+	}
+
+	// Large allocations get a block of their own
+	size_t capacity = std::max(blockSize, size + alignment);
+	Block* block = (Block*)malloc(sizeof(Block) + capacity);
+	assert(block != nullptr);
+	block->next = nullptr;
+	block->size = capacity;
+	block->used = 0;
+	if (current == nullptr) first = block;
+	else current->next = block;
+	current = block;
+	return block->allocate(size, alignment);
+}
+
+Memory::Arena::Marker Memory::Arena::getMarker() const {
+	Marker marker;
+	marker.block = current;
+	marker.used = current != nullptr ? current->used : 0;
+	return marker;
+}
+
+void Memory::Arena::rewind(const Marker& marker) {
+	if (marker.block == nullptr) {
+		reset();
+		return;
+	}
+	current = marker.block;
+	current->used = marker.used;
+}
+
+void Memory::Arena::reset() {
+	current = first;
+	if (current != nullptr) current->used = 0;
+}
+
+size_t Memory::Arena::getUsed() const {
+	if (current == nullptr) return 0;
+	size_t used = 0;
+	for (Block* block = first; block != current; block = block->next) {
+		used += block->used;
+	}
+	return used + current->used;
+}
+
+size_t Memory::Arena::getCapacity() const {
+	size_t capacity = 0;
+	for (Block* block = first; block != nullptr; block = block->next) {
+		capacity += block->size;
+	}
+	return capacity;
+}
+
+Memory::ScratchStack::ScratchStack() : arena(scratchBlockSize), highWater(0), depth(0) {}
+
+void* Memory::ScratchStack::allocate(size_t size, size_t alignment) {
+	// Outside of a scope the memory would never be released
+	assert(depth > 0);
+	size_t before = arena.getUsed();
+#ifndef NDEBUG
+	u8* data = (u8*)arena.allocate(size + guardSize, alignment);
+	memset(data + size, guardByte, guardSize);
+	guards.push_back(data + size);
+#else
+	void* data = arena.allocate(size, alignment);
+#endif
+	size_t used = arena.getUsed();
+	track(ScratchMemory, used - before);
+	highWater = std::max(highWater, used);
+	return data;
+}
+
+Memory::ScratchStack::Position Memory::ScratchStack::push() {
+	++depth;
+	Position position;
+	position.marker = arena.getMarker();
+	position.guards = 0;
+#ifndef NDEBUG
+	position.guards = guards.size();
+#endif
+	return position;
+}
+
+void Memory::ScratchStack::pop(const Position& position) {
+	assert(depth > 0);
+	--depth;
+#ifndef NDEBUG
+	// Something wrote past the end of one of the allocations of the scope
+	for (size_t i = position.guards; i < guards.size(); ++i) {
+		for (size_t j = 0; j < guardSize; ++j) {
+			assert(guards[i][j] == guardByte);
+		}
+	}
+	guards.resize(position.guards);
+#endif
+	size_t before = arena.getUsed();
+	arena.rewind(position.marker);
+	untrack(ScratchMemory, before - arena.getUsed());
+}
+
+size_t Memory::ScratchStack::getHighWater() const {
+	return highWater;
+}
+
+Memory::ScratchScope::ScratchScope() : stack(scratchStack()), position(stack.push()) {}
+
+Memory::ScratchScope::~ScratchScope() {
+	stack.pop(position);
 }
 
 void Memory::init() {
-	memory = new u8[memorySize];
-	index = scratchPadSize;
+	// Create the arenas of the main thread up front
+	getThreadArenas();
 }
 
 void* Memory::scratchPad(size_t size) {
-	assert(size < scratchPadSize);
-	return memory;
+	return scratchStack().allocate(size);
 }
 
-void* Memory::allocate(size_t size) {
-	assert(index + size < memorySize);
-	void* data = &memory[index];
-	index += size;
-	return data;
+void Memory::track(Tag tag, size_t bytes) {
+	TagCounters& counter = counters[tag];
+	counter.allocations.fetch_add(1, std::memory_order_relaxed);
+	size_t live = counter.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	size_t peak = counter.peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !counter.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+void Memory::untrack(Tag tag, size_t bytes) {
+	counters[tag].liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+Memory::Usage Memory::getUsage(Tag tag) {
+	Usage usage;
+	usage.liveBytes = counters[tag].liveBytes.load(std::memory_order_relaxed);
+	usage.peakBytes = counters[tag].peakBytes.load(std::memory_order_relaxed);
+	usage.allocations = counters[tag].allocations.load(std::memory_order_relaxed);
+	return usage;
+}
+
+const char* Memory::getTagName(Tag tag) {
+	return tagNames[tag];
+}
+
+void Memory::logUsage() {
+	for (int tag = 0; tag < TagCount; ++tag) {
+		Usage usage = getUsage((Tag)tag);
+		Kore::log(Kore::Info, "Memory %s: %zu bytes live, %zu bytes peak, %zu allocations", tagNames[tag], usage.liveBytes, usage.peakBytes, usage.allocations);
+	}
+	logScratchUsage();
+}
+
+void* Memory::allocate(size_t size, Tag tag) {
+	track(tag, size);
+	std::lock_guard<std::mutex> lock(permanentMutex);
+	return permanent.allocate(size);
+}
+
+void* Memory::allocateLevel(size_t size, Tag tag) {
+	track(tag, size);
+	std::lock_guard<std::mutex> lock(levelMutex);
+	levelBytes[tag] += size;
+	return level.allocate(size);
+}
+
+void Memory::resetLevel() {
+	std::lock_guard<std::mutex> lock(levelMutex);
+	level.reset();
+	for (int tag = 0; tag < TagCount; ++tag) {
+		untrack((Tag)tag, levelBytes[tag]);
+		levelBytes[tag] = 0;
+	}
+}
+
+void* Memory::allocateFrame(size_t size, Tag tag) {
+	track(tag, size);
+	ThreadArenas& arenas = getThreadArenas();
+	arenas.frameBytes[tag] += size;
+	return arenas.frame.allocate(size, frameAlignment);
+}
+
+void Memory::resetFrame() {
+	std::lock_guard<std::mutex> lock(threadArenasMutex);
+	for (size_t i = 0; i < threadArenas.size(); ++i) {
+		threadArenas[i]->frame.reset();
+		for (int tag = 0; tag < TagCount; ++tag) {
+			untrack((Tag)tag, threadArenas[i]->frameBytes[tag]);
+			threadArenas[i]->frameBytes[tag] = 0;
+		}
+	}
+}
+
+Memory::ScratchStack& Memory::scratchStack() {
+	return getThreadArenas().scratch;
+}
+
+void Memory::logScratchUsage() {
+	std::lock_guard<std::mutex> lock(threadArenasMutex);
+	for (size_t i = 0; i < threadArenas.size(); ++i) {
+		Kore::log(Kore::Info, "Scratch memory of thread %d: %zu bytes at most", (int)i, threadArenas[i]->scratch.getHighWater());
+	}
 }
@@ -1,19 +1,205 @@
 #pragma once
 
 #include <stdlib.h>
+#include <vector>
 
 namespace Memory {
+	// What memory is used for. Live bytes, peak bytes and allocations are counted per tag
+	enum Tag {
+		OtherMemory,
+		MeshMemory,
+		AIMemory,
+		ActionMemory,
+		ScratchMemory,
+		TagCount
+	};
+	
+	struct Usage {
+		size_t liveBytes;
+		size_t peakBytes;
+		// Since the start, including the ones that were released
+		size_t allocations;
+	};
+	
+	// Counts an allocation or a release. The allocation functions below do it themselves. Can be used from several threads at once
+	void track(Tag tag, size_t bytes);
+	void untrack(Tag tag, size_t bytes);
+	
+	Usage getUsage(Tag tag);
+	const char* getTagName(Tag tag);
+	
+	// Logs the usage of every tag and the scratch high-water marks
+	void logUsage();
+	
+	// Base class that counts the objects of a class that are created with new under a tag, arrays included.
+	// delete is given the size of the class it is called on, so polymorphic classes need a virtual destructor
+	template<Tag tag> class Tracked {
+	public:
+		static void* operator new(size_t size) {
+			track(tag, size);
+			return ::operator new(size);
+		}
+		
+		static void operator delete(void* data, size_t size) {
+			untrack(tag, size);
+			::operator delete(data);
+		}
+		
+		static void* operator new[](size_t size) {
+			track(tag, size);
+			return ::operator new[](size);
+		}
+		
+		static void operator delete[](void* data, size_t size) {
+			untrack(tag, size);
+			::operator delete[](data);
+		}
+	};
+	
+	// A chain of blocks that allocates by bumping a pointer and grows by another block when the current one is full.
+	// Memory is only given back all at once or up to a marker, the blocks are kept for the next allocations.
+	// Not thread-safe, use one arena per thread or the shared arenas below
+	class Arena {
+	public:
+		struct Block;
+		
+		// A position in the arena to rewind to
+		struct Marker {
+			Block* block;
+			size_t used;
+		};
+		
+		explicit Arena(size_t blockSize = 1024 * 1024);
+		~Arena();
+		
+		// alignment has to be a power of two
+		void* allocate(size_t size, size_t alignment = 16);
+		
+		template<class T> T* allocate(size_t count = 1) {
+			return (T*)allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+		}
+		
+		Marker getMarker() const;
+		
+		// Releases everything allocated after the marker was taken
+		void rewind(const Marker& marker);
+		
+		// Releases everything
+		void reset();
+		
+		// Bytes handed out, including alignment padding, and bytes reserved in blocks
+		size_t getUsed() const;
+		size_t getCapacity() const;
+		
+	private:
+		Arena(const Arena&);
+		Arena& operator=(const Arena&);
+		
+		Block* first;
+		Block* current;
+		size_t blockSize;
+	};
+	
+	// Rewinds an arena to where it was when the scope started
+	class Scope {
+	public:
+		explicit Scope(Arena& arena) : arena(arena), marker(arena.getMarker()) {}
+		~Scope() { arena.rewind(marker); }
+		
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+		
+		Arena& arena;
+		Arena::Marker marker;
+	};
+	
+	// Temporary memory of one thread, used like a stack: open a ScratchScope, allocate, and the scope releases everything.
+	// Grows like an arena. Debug builds put guard bytes behind every allocation and check them when the scope ends
+	class ScratchStack {
+	public:
+		struct Position {
+			Arena::Marker marker;
+			size_t guards;
+		};
+		
+		ScratchStack();
+		
+		void* allocate(size_t size, size_t alignment = 16);
+		
+		// Used by ScratchScope
+		Position push();
+		void pop(const Position& position);
+		
+		// The most memory that was in use at once
+		size_t getHighWater() const;
+		
+	private:
+		ScratchStack(const ScratchStack&);
+		ScratchStack& operator=(const ScratchStack&);
+		
+		Arena arena;
+		size_t highWater;
+		int depth;
+#ifndef NDEBUG
+		std::vector<unsigned char*> guards;
+#endif
+	};
+	
+	// Releases the scratch memory of the calling thread that was allocated since the scope started. Scopes can be nested
+	class ScratchScope {
+	public:
+		ScratchScope();
+		~ScratchScope();
+		
+	private:
+		ScratchScope(const ScratchScope&);
+		ScratchScope& operator=(const ScratchScope&);
+		
+		ScratchStack& stack;
+		ScratchStack::Position position;
+	};
+	
 	void init();
 	
-	void* allocate(size_t size);
+	// Memory that is never released. Can be used from several threads at once
+	void* allocate(size_t size, Tag tag = OtherMemory);
 	
-	template<class T> T* allocate(size_t count = 1) {
-		return (T*)allocate(count * sizeof(T));
+	template<class T> T* allocate(size_t count = 1, Tag tag = OtherMemory) {
+		return (T*)allocate(count * sizeof(T), tag);
 	}
 	
+	// Memory that lives until the next resetLevel. Can be used from several threads at once
+	void* allocateLevel(size_t size, Tag tag = OtherMemory);
+	
+	template<class T> T* allocateLevel(size_t count = 1, Tag tag = OtherMemory) {
+		return (T*)allocateLevel(count * sizeof(T), tag);
+	}
+	
+	// Releases all level memory at once. No other thread may allocate level memory meanwhile
+	void resetLevel();
+	
+	// Scratch memory of the calling thread, valid until the innermost ScratchScope ends.
+	// Every thread has its own, so loaders and jobs can use it at the same time
 	void* scratchPad(size_t size);
 	
 	template<class T> T* scratchPad(size_t count = 1) {
 		return (T*)scratchPad(count * sizeof(T));
 	}
+	
+	// Memory that lives until the next resetFrame. Aligned for any type, can be used from several threads at once
+	void* allocateFrame(size_t size, Tag tag = OtherMemory);
+	
+	template<class T> T* allocateFrame(size_t count = 1, Tag tag = OtherMemory) {
+		return (T*)allocateFrame(count * sizeof(T), tag);
+	}
+	
+	// Releases all frame memory at once. Call it between frames, when no other thread allocates frame memory
+	void resetFrame();
+	
+	// The calling thread's scratch stack
+	ScratchStack& scratchStack();
+	
+	// Logs the scratch high-water mark of every thread
+	void logScratchUsage();
 }
@@ -0,0 +1,75 @@
+#include "pch.h"
+
+// Converts .obj files into binary mesh files next to them, which MeshObject then loads instead.
+// --optimize reorders triangles and vertices for the GPU's vertex cache and fetch.
+// Mesh files that were made from the current version of their .obj file are skipped, --force converts them anyway.
+// Deployment/Makefile builds it and converts the level meshes, otherwise build with the environment variable
+// EXERCISE_MESH_CONVERTER set and run it from the Deployment directory.
+// Usage: Exercise13 [--optimize] [--force] Level/ball.obj [Level/boid.obj ...]
+#ifdef EXERCISE_MESH_CONVERTER
+
+#include <Kore/Log.h>
+
+#include "Memory.h"
+#include "ObjLoader.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "JobScheduler.h"
+
+#include <string.h>
+
+int kore(int argc, char** argv) {
+	bool optimize = false;
+	bool force = false;
+	int firstFile = 1;
+	for (; firstFile < argc && strncmp(argv[firstFile], "--", 2) == 0; ++firstFile) {
+		if (strcmp(argv[firstFile], "--optimize") == 0) optimize = true;
+		else if (strcmp(argv[firstFile], "--force") == 0) force = true;
+		else break;
+	}
+	if (argc <= firstFile || strncmp(argv[firstFile], "--", 2) == 0) {
+		Kore::log(Kore::Error, "Usage: %s [--optimize] [--force] mesh.obj [mesh.obj ...]", argv[0]);
+		return 1;
+	}
+
+	Memory::init();
+	JobScheduler scheduler;
+
+	int result = 0;
+	for (int i = firstFile; i < argc; ++i) {
+		MeshSource source;
+		if (!getMeshSource(argv[i], source)) {
+			Kore::log(Kore::Error, "Could not find %s", argv[i]);
+			result = 1;
+			continue;
+		}
+
+		char binaryFile[256];
+		getMeshFileName(argv[i], binaryFile, sizeof(binaryFile));
+		MeshFile existing;
+		if (!force && existing.open(binaryFile) && existing.isMadeFrom(source)) {
+			Kore::log(Kore::Info, "%s is up to date", binaryFile);
+			continue;
+		}
+		existing.close();
+
+		Mesh* mesh = loadObjWelded(argv[i], &scheduler);
+		if (optimize) optimizeMesh(mesh, argv[i]);
+
+		if (writeMeshFile(binaryFile, mesh, source)) {
+			Kore::log(Kore::Info, "%s: %d vertices, %d triangles -> %s", argv[i], mesh->numVertices, mesh->numFaces, binaryFile);
+		}
+		else {
+			Kore::log(Kore::Error, "Could not write %s", binaryFile);
+			result = 1;
+		}
+		
+		// The mesh has been written, the next one can use its memory
+		Memory::resetLevel();
+	}
+	
+	Memory::logScratchUsage();
+	return result;
+}
+
+#endif
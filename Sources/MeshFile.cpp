@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "MeshFile.h"
+
+#include <Kore/IO/FileReader.h>
+#include <Kore/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char magic[4] = { 'K', 'M', 'S', 'H' };
+	const int version = 3;
+
+	// The blocks start at multiples of this, so the vertices can be read with aligned loads
+	const int blockAlignment = 16;
+
+	int align(int offset) {
+		return (offset + blockAlignment - 1) / blockAlignment * blockAlignment;
+	}
+
+	// Fills the gap up to the next block with zeros
+	bool writePadding(FILE* file, int count) {
+		const char padding[blockAlignment] = { 0 };
+		return count == 0 || fwrite(padding, count, 1, file) == 1;
+	}
+}
+
+bool getMeshSource(const char* objFile, MeshSource& source) {
+#ifdef _WIN32
+	struct _stat64 status;
+	if (_stat64(objFile, &status) != 0) return false;
+#else
+	struct stat status;
+	if (stat(objFile, &status) != 0) return false;
+#endif
+	source.size = (long long)status.st_size;
+	source.time = (long long)status.st_mtime;
+	return true;
+}
+
+bool writeMeshFile(const char* filename, const Mesh* mesh, const MeshSource& source) {
+	MeshFileHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.numVertices = mesh->numVertices;
+	header.numIndices = mesh->numFaces * 3;
+	header.vertexOffset = align(sizeof(MeshFileHeader));
+	header.indexOffset = align(header.vertexOffset + header.numVertices * 8 * (int)sizeof(float));
+	header.sourceSize = source.size;
+	header.sourceTime = source.time;
+
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr) return false;
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+	success = success && writePadding(file, header.vertexOffset - (int)sizeof(header));
+	for (int i = 0; i < mesh->numVertices && success; ++i) {
+		float vertex[8];
+		memcpy(vertex, &mesh->vertices[i * 8], sizeof(vertex));
+		vertex[4] = 1.0f - vertex[4];
+		success = fwrite(vertex, sizeof(vertex), 1, file) == 1;
+	}
+
+	int vertexEnd = header.vertexOffset + header.numVertices * 8 * (int)sizeof(float);
+	success = success && writePadding(file, header.indexOffset - vertexEnd);
+	success = success && fwrite(mesh->indices, sizeof(int), header.numIndices, file) == (size_t)header.numIndices;
+
+	return fclose(file) == 0 && success;
+}
+
+void getMeshFileName(const char* objFile, char* result, size_t size) {
+	const char* extension = strrchr(objFile, '.');
+	size_t length = extension != nullptr ? extension - objFile : strlen(objFile);
+	snprintf(result, size, "%.*s.kmesh", (int)length, objFile);
+}
+
+MeshFile::MeshFile() : data(nullptr), size(0), file(nullptr), mapping(nullptr), buffer(nullptr) {}
+
+MeshFile::~MeshFile() {
+	close();
+}
+
+bool MeshFile::open(const char* filename) {
+	close();
+
+	// Mapping only finds files at their plain path, FileReader also finds packed assets
+	if (!map(filename) && !read(filename)) return false;
+
+	if (size < sizeof(MeshFileHeader) || !validate()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MeshFile::openFor(const char* objFile) {
+	char binaryFile[256];
+	getMeshFileName(objFile, binaryFile, sizeof(binaryFile));
+	if (!open(binaryFile)) return false;
+
+	MeshSource source;
+	if (!getMeshSource(objFile, source) || isMadeFrom(source)) return true;
+
+	Kore::log(Kore::Warning, "%s was made from another version of %s, loading the .obj file instead", binaryFile, objFile);
+	close();
+	return false;
+}
+
+bool MeshFile::isMadeFrom(const MeshSource& source) const {
+	const MeshFileHeader* header = (const MeshFileHeader*)data;
+	return header->sourceSize == source.size && header->sourceTime == source.time;
+}
+
+bool MeshFile::map(const char* filename) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	file = handle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshFileHeader)) {
+		close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+	data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		close();
+		return false;
+	}
+	return true;
+#else
+	int descriptor = ::open(filename, O_RDONLY);
+	if (descriptor < 0) return false;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size < (off_t)sizeof(MeshFileHeader)) {
+		::close(descriptor);
+		return false;
+	}
+	size = (size_t)status.st_size;
+
+	void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// The mapping stays valid without the descriptor
+	::close(descriptor);
+	if (memory == MAP_FAILED) {
+		size = 0;
+		return false;
+	}
+	data = (const unsigned char*)memory;
+	return true;
+#endif
+}
+
+bool MeshFile::read(const char* filename) {
+	Kore::FileReader reader;
+	if (!reader.open(filename, Kore::FileReader::Asset)) return false;
+	int fileSize = reader.size();
+	if (fileSize < (int)sizeof(MeshFileHeader)) {
+		reader.close();
+		return false;
+	}
+
+	// malloc aligns for the floats and ints, the buffer of the reader is released with it
+	buffer = (unsigned char*)malloc(fileSize);
+	memcpy(buffer, reader.readAll(), fileSize);
+	reader.close();
+	data = buffer;
+	size = (size_t)fileSize;
+	return true;
+}
+
+void MeshFile::close() {
+	if (buffer != nullptr) {
+		free(buffer);
+	}
+	else {
+#ifdef _WIN32
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != nullptr) CloseHandle(file);
+#else
+		if (data != nullptr) munmap((void*)data, size);
+#endif
+	}
+	buffer = nullptr;
+	data = nullptr;
+	size = 0;
+	file = nullptr;
+	mapping = nullptr;
+}
+
+bool MeshFile::validate() const {
+	const MeshFileHeader* header = (const MeshFileHeader*)data;
+	if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version) return false;
+	if (header->numVertices < 0 || header->numIndices < 0 || header->numIndices % 3 != 0) return false;
+	if (header->vertexOffset % blockAlignment != 0 || header->indexOffset % blockAlignment != 0) return false;
+	size_t vertexEnd = (size_t)header->vertexOffset + (size_t)header->numVertices * 8 * sizeof(float);
+	size_t indexEnd = (size_t)header->indexOffset + (size_t)header->numIndices * sizeof(int);
+	if (header->vertexOffset < (int)sizeof(MeshFileHeader) || vertexEnd > (size_t)header->indexOffset || indexEnd > size) return false;
+
+	// Every index has to point at a vertex
+	const int* indices = getIndices();
+	for (int i = 0; i < header->numIndices; ++i) {
+		if (indices[i] < 0 || indices[i] >= header->numVertices) return false;
+	}
+	return true;
+}
+
+int MeshFile::getNumVertices() const {
+	return ((const MeshFileHeader*)data)->numVertices;
+}
+
+int MeshFile::getNumIndices() const {
+	return ((const MeshFileHeader*)data)->numIndices;
+}
+
+const float* MeshFile::getVertices() const {
+	return (const float*)(data + ((const MeshFileHeader*)data)->vertexOffset);
+}
+
+const int* MeshFile::getIndices() const {
+	return (const int*)(data + ((const MeshFileHeader*)data)->indexOffset);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+#include <stddef.h>
+
+// Binary mesh files (.kmesh) hold a mesh exactly as the vertex and index buffers of MeshObject expect it,
+// so loading one is a copy instead of parsing text. The mesh converter creates them from .obj files, Deployment/Makefile runs it
+// for the level meshes and skips the ones that are up to date. A mesh file remembers the size and modification time of the .obj
+// it was made from and is ignored once they change, which only costs a stat of the .obj.
+struct MeshFileHeader {
+	// "KMSH"
+	char magic[4];
+	int version;
+	int numVertices;
+	int numIndices;
+	// Bytes from the start of the file to the vertices, 8 floats each: position, uv, normal
+	int vertexOffset;
+	// Bytes from the start of the file to the indices, one int each
+	int indexOffset;
+	// Size and modification time of the .obj file the mesh was made from
+	long long sourceSize;
+	long long sourceTime;
+};
+
+// Identifies a version of an .obj file without reading it
+struct MeshSource {
+	long long size;
+	long long time;
+};
+
+// Asks the file system about the .obj file, returns false if it is not a plain file, e.g. because the platform packs the assets
+bool getMeshSource(const char* objFile, MeshSource& source);
+
+// Writes an .obj mesh as a binary mesh file. Flips v like MeshObject does when it loads an .obj
+bool writeMeshFile(const char* filename, const Mesh* mesh, const MeshSource& source);
+
+// Writes the name of the binary mesh file that belongs to objFile into result, e.g. Level/ball.kmesh for Level/ball.obj
+void getMeshFileName(const char* objFile, char* result, size_t size);
+
+// A binary mesh file mapped into memory. Where the file cannot be mapped, e.g. because the platform packs the assets,
+// it is read through Kore's FileReader instead
+class MeshFile {
+public:
+	MeshFile();
+	~MeshFile();
+
+	// Maps or reads the file and checks its header, returns false if it is missing or invalid
+	bool open(const char* filename);
+
+	// Opens the binary mesh file that belongs to objFile, see getMeshFileName, unless it was made from another version of objFile.
+	// Without the .obj file the mesh file is used as it is
+	bool openFor(const char* objFile);
+
+	// True if the open file was made from this version of its .obj file
+	bool isMadeFrom(const MeshSource& source) const;
+	void close();
+
+	int getNumVertices() const;
+	int getNumIndices() const;
+
+	// Valid until the file is closed
+	const float* getVertices() const;
+	const int* getIndices() const;
+
+private:
+	MeshFile(const MeshFile&);
+	MeshFile& operator=(const MeshFile&);
+
+	bool map(const char* filename);
+	bool read(const char* filename);
+	bool validate() const;
+
+	const unsigned char* data;
+	size_t size;
+	void* file;
+	void* mapping;
+	// The copy of the file when it was read instead of mapped
+	unsigned char* buffer;
+};
@@ -2,14 +2,44 @@
 
 #include <Kore/Graphics4/Graphics.h>
 #include "ObjLoader.h"
+#include "MeshFile.h"
+#include "AssetLoader.h"
+#include "Memory.h"
+
+#include <string.h>
 
 namespace {
-	class MeshObject {
+	class MeshObject : public Memory::Tracked<Memory::MeshMemory> {
 	public:
-		MeshObject(const char* meshFile, const char* textureFile, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f) {
-			mesh = loadObj(meshFile);
+		MeshObject(const char* meshFile, const char* textureFile, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f) : mesh(nullptr), loader(nullptr), meshRequest(nullptr), textureRequest(nullptr) {
 			image = new Kore::Graphics4::Texture(textureFile, true);
 			
+			// Prefer the binary version of the mesh, it can be copied into the buffers as it is
+			MeshFile file;
+			if (file.openFor(meshFile)) {
+				vertexBuffer = new Kore::Graphics4::VertexBuffer(file.getNumVertices(), structure, 0);
+				float* vertices = vertexBuffer->lock();
+				if (scale == 1.0f) {
+					memcpy(vertices, file.getVertices(), file.getNumVertices() * 8 * sizeof(float));
+				}
+				else {
+					const float* source = file.getVertices();
+					for (int i = 0; i < file.getNumVertices() * 8; ++i) {
+						vertices[i] = i % 8 < 3 ? source[i] * scale : source[i];
+					}
+				}
+				vertexBuffer->unlock();
+				
+				indexBuffer = new Kore::Graphics4::IndexBuffer(file.getNumIndices());
+				memcpy(indexBuffer->lock(), file.getIndices(), file.getNumIndices() * sizeof(int));
+				indexBuffer->unlock();
+				
+				M = Kore::mat4::Identity();
+				return;
+			}
+			
+			mesh = loadObjWelded(meshFile);
+			
 			vertexBuffer = new Kore::Graphics4::VertexBuffer(mesh->numVertices, structure, 0);
 			float* vertices = vertexBuffer->lock();
 			for (int i = 0; i < mesh->numVertices; ++i) {
@@ -36,10 +66,37 @@ namespace {
 		
 		/** Mesh object from already loaded assets */
 		MeshObject(Kore::Graphics4::VertexBuffer* inVertexBuffer, Kore::Graphics4::IndexBuffer* inIndexBuffer, Kore::Graphics4::Texture* inTexture)
-		: vertexBuffer(inVertexBuffer), indexBuffer(inIndexBuffer), image(inTexture), M(Kore::mat4::Identity()) {
+		: M(Kore::mat4::Identity()), vertexBuffer(inVertexBuffer), indexBuffer(inIndexBuffer), mesh(nullptr), image(inTexture), loader(nullptr), meshRequest(nullptr), textureRequest(nullptr) {
+		}
+		
+		/** Mesh object from the assets of an AssetLoader. Objects with the same files share the buffers and the texture, they are loaded in the background and the object is not drawn until they are ready. Only a readable texture keeps its pixels on the CPU */
+		MeshObject(AssetLoader* inLoader, const char* meshFile, const char* textureFile, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f, bool readable = false)
+		: M(Kore::mat4::Identity()), vertexBuffer(nullptr), indexBuffer(nullptr), mesh(nullptr), image(nullptr), loader(inLoader) {
+			meshRequest = loader->loadMesh(meshFile, structure, scale);
+			textureRequest = loader->loadTexture(textureFile, readable);
+		}
+		
+		~MeshObject() {
+			if (loader != nullptr) {
+				loader->release(meshRequest);
+				loader->release(textureRequest);
+			}
+		}
+		
+		// True once the buffers and the texture can be used
+		bool isReady() {
+			if (vertexBuffer == nullptr && meshRequest != nullptr && meshRequest->ready) {
+				vertexBuffer = meshRequest->vertexBuffer;
+				indexBuffer = meshRequest->indexBuffer;
+			}
+			if (image == nullptr && textureRequest != nullptr && textureRequest->ready) {
+				image = textureRequest->texture;
+			}
+			return vertexBuffer != nullptr && image != nullptr;
 		}
 		
 		void render(Kore::Graphics4::TextureUnit tex) {
+			if (!isReady()) return;
 			Kore::Graphics4::setTexture(tex, image);
 			Kore::Graphics4::setVertexBuffer(*vertexBuffer);
 			Kore::Graphics4::setIndexBuffer(*indexBuffer);
@@ -67,10 +124,18 @@ namespace {
 		Kore::mat4 M;
 		
 	private:
+		// A copy would release the assets of the loader a second time
+		MeshObject(const MeshObject&);
+		MeshObject& operator=(const MeshObject&);
+		
 		Kore::Graphics4::VertexBuffer* vertexBuffer;
 		Kore::Graphics4::IndexBuffer* indexBuffer;
 		Mesh* mesh;
 		Kore::Graphics4::Texture* image;
+		// Set when the assets come from a loader, they are released with the object
+		AssetLoader* loader;
+		MeshRequest* meshRequest;
+		TextureRequest* textureRequest;
 	};
 	
 }
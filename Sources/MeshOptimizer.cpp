@@ -0,0 +1,284 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <Kore/Math/Vector.h>
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+namespace {
+	// The cache the triangle order is optimized for, modelled as LRU like in Forsyth's article
+	const int optimizedCacheSize = 32;
+
+	// Scores from Forsyth's article
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+
+	// How much the vertex is worth using next. Vertices near the front of the cache and vertices with few triangles left score high
+	float vertexScore(int cachePosition, int remainingTriangles) {
+		if (remainingTriangles == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3) {
+				// The vertices of the last triangle, slightly less valuable than the rest of the front so strips do not turn back
+				score = lastTriangleScore;
+			}
+			else {
+				float scaler = 1.0f / (optimizedCacheSize - 3);
+				score = Kore::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+			}
+		}
+
+		// Finish off vertices with few triangles left so they do not have to be transformed again later
+		score += valenceBoostScale * Kore::pow((float)remainingTriangles, -valenceBoostPower);
+		return score;
+	}
+
+	// A FIFO vertex cache like the post-transform cache of a GPU
+	class VertexCacheSimulation {
+	public:
+		VertexCacheSimulation(int vertices, int cacheSize) : insertedAt(vertices, -cacheSize), misses(0), size(cacheSize) {}
+
+		// Returns true if the vertex was not in the cache and had to be transformed
+		bool transform(int vertex) {
+			if (misses - insertedAt[vertex] < size) return false;
+			insertedAt[vertex] = misses;
+			++misses;
+			return true;
+		}
+
+	private:
+		// The number of misses when the vertex was put into the cache
+		std::vector<int> insertedAt;
+		int misses;
+		int size;
+	};
+
+	Kore::vec3 getPosition(const Mesh* mesh, int vertex) {
+		return Kore::vec3(mesh->vertices[vertex * 8 + 0], mesh->vertices[vertex * 8 + 1], mesh->vertices[vertex * 8 + 2]);
+	}
+
+	Kore::vec3 cross(const Kore::vec3& a, const Kore::vec3& b) {
+		return Kore::vec3(a.y() * b.z() - a.z() * b.y(), a.z() * b.x() - a.x() * b.z(), a.x() * b.y() - a.y() * b.x());
+	}
+
+	// A run of triangles that is drawn as a whole when optimizing overdraw
+	struct Cluster {
+		int firstTriangle;
+		int triangleCount;
+		// Larger for clusters further out in the direction they face
+		float sortKey;
+	};
+
+	bool drawsEarlier(const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	}
+}
+
+void optimizeVertexCache(Mesh* mesh) {
+	const int triangles = mesh->numIndices / 3;
+	const int vertices = mesh->numVertices;
+	if (triangles == 0) return;
+	int* indices = mesh->indices;
+
+	// The triangles of every vertex, the first remainingTriangles of them are not emitted yet
+	std::vector<int> triangleOffset(vertices + 1, 0);
+	for (int i = 0; i < triangles * 3; ++i) {
+		++triangleOffset[indices[i] + 1];
+	}
+	for (int v = 0; v < vertices; ++v) {
+		triangleOffset[v + 1] += triangleOffset[v];
+	}
+	std::vector<int> vertexTriangles(triangles * 3);
+	std::vector<int> remainingTriangles(vertices, 0);
+	for (int i = 0; i < triangles * 3; ++i) {
+		int v = indices[i];
+		vertexTriangles[triangleOffset[v] + remainingTriangles[v]++] = i / 3;
+	}
+
+	std::vector<int> cachePosition(vertices, -1);
+	std::vector<float> score(vertices);
+	for (int v = 0; v < vertices; ++v) {
+		score[v] = vertexScore(-1, remainingTriangles[v]);
+	}
+
+	std::vector<float> triangleScore(triangles);
+	int best = 0;
+	for (int t = 0; t < triangles; ++t) {
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+		if (triangleScore[t] > triangleScore[best]) best = t;
+	}
+
+	std::vector<bool> emitted(triangles, false);
+	std::vector<int> result;
+	result.reserve(triangles * 3);
+
+	int cache[optimizedCacheSize + 3];
+	int cacheSize = 0;
+	int nextCandidate = 0;
+
+	for (int count = 0; count < triangles; ++count) {
+		if (best < 0) {
+			// No triangle uses a cached vertex, continue with the first one that is left
+			while (emitted[nextCandidate]) ++nextCandidate;
+			best = nextCandidate;
+		}
+
+		const int* triangle = &indices[best * 3];
+		result.push_back(triangle[0]);
+		result.push_back(triangle[1]);
+		result.push_back(triangle[2]);
+		emitted[best] = true;
+
+		// Put the triangle's vertices in front of the cache and take the triangle out of their lists
+		int newCache[optimizedCacheSize + 3];
+		int newCacheSize = 0;
+		for (int k = 0; k < 3; ++k) {
+			int v = triangle[k];
+			int* first = &vertexTriangles[triangleOffset[v]];
+			int* last = first + remainingTriangles[v] - 1;
+			int* position = std::find(first, last + 1, best);
+			std::swap(*position, *last);
+			--remainingTriangles[v];
+
+			if (std::find(newCache, newCache + newCacheSize, v) == newCache + newCacheSize) {
+				newCache[newCacheSize++] = v;
+			}
+		}
+		for (int i = 0; i < cacheSize; ++i) {
+			int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				newCache[newCacheSize++] = v;
+			}
+		}
+
+		// Vertices behind the end of the cache fall out
+		for (int i = 0; i < newCacheSize; ++i) {
+			int v = newCache[i];
+			cachePosition[v] = i < optimizedCacheSize ? i : -1;
+			score[v] = vertexScore(cachePosition[v], remainingTriangles[v]);
+		}
+		cacheSize = std::min(newCacheSize, optimizedCacheSize);
+		memcpy(cache, newCache, cacheSize * sizeof(int));
+
+		// Only the triangles of these vertices changed their score, continue with the best of them
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCacheSize; ++i) {
+			int v = newCache[i];
+			for (int j = 0; j < remainingTriangles[v]; ++j) {
+				int t = vertexTriangles[triangleOffset[v] + j];
+				triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, result.data(), result.size() * sizeof(int));
+}
+
+void optimizeOverdraw(Mesh* mesh) {
+	const int triangles = mesh->numIndices / 3;
+	if (triangles == 0) return;
+	const int* indices = mesh->indices;
+
+	// A cluster starts where all vertices of a triangle miss the cache, reordering the clusters keeps the cache hits
+	std::vector<Cluster> clusters;
+	VertexCacheSimulation cache(mesh->numVertices, 16);
+	for (int t = 0; t < triangles; ++t) {
+		int misses = cache.transform(indices[t * 3]) + cache.transform(indices[t * 3 + 1]) + cache.transform(indices[t * 3 + 2]);
+		if (misses == 3 || t == 0) {
+			Cluster cluster;
+			cluster.firstTriangle = t;
+			cluster.triangleCount = 0;
+			clusters.push_back(cluster);
+		}
+		++clusters.back().triangleCount;
+	}
+
+	// Area weighted centroids and normals of the clusters and of the whole mesh
+	std::vector<Kore::vec3> centroids(clusters.size());
+	std::vector<Kore::vec3> normals(clusters.size());
+	Kore::vec3 meshCentroid(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		Kore::vec3 centroid(0.0f, 0.0f, 0.0f);
+		Kore::vec3 clusterNormal(0.0f, 0.0f, 0.0f);
+		float clusterArea = 0.0f;
+		for (int t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; ++t) {
+			Kore::vec3 a = getPosition(mesh, indices[t * 3]);
+			Kore::vec3 b = getPosition(mesh, indices[t * 3 + 1]);
+			Kore::vec3 d = getPosition(mesh, indices[t * 3 + 2]);
+			Kore::vec3 normal = cross(b - a, d - a);
+			float area = normal.getLength();
+			centroid += (a + b + d) * (area / 3.0f);
+			clusterNormal += normal;
+			clusterArea += area;
+		}
+		meshCentroid += centroid;
+		meshArea += clusterArea;
+		centroids[c] = clusterArea > 0.0f ? centroid * (1.0f / clusterArea) : centroid;
+		float length = clusterNormal.getLength();
+		normals[c] = length > 0.0f ? clusterNormal * (1.0f / length) : clusterNormal;
+	}
+	if (meshArea > 0.0f) meshCentroid = meshCentroid * (1.0f / meshArea);
+
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		clusters[c].sortKey = (centroids[c] - meshCentroid).dot(normals[c]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), drawsEarlier);
+
+	std::vector<int> result;
+	result.reserve(triangles * 3);
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		const int* first = &indices[clusters[c].firstTriangle * 3];
+		result.insert(result.end(), first, first + clusters[c].triangleCount * 3);
+	}
+	memcpy(mesh->indices, result.data(), result.size() * sizeof(int));
+}
+
+void optimizeVertexFetch(Mesh* mesh) {
+	std::vector<int> remap(mesh->numVertices, -1);
+	int nextVertex = 0;
+	for (int i = 0; i < mesh->numIndices; ++i) {
+		int& index = mesh->indices[i];
+		if (remap[index] < 0) remap[index] = nextVertex++;
+		index = remap[index];
+	}
+
+	std::vector<float> vertices(mesh->vertices, mesh->vertices + mesh->numVertices * 8);
+	for (int v = 0; v < mesh->numVertices; ++v) {
+		if (remap[v] >= 0) memcpy(&mesh->vertices[remap[v] * 8], &vertices[v * 8], 8 * sizeof(float));
+	}
+	mesh->numVertices = nextVertex;
+	mesh->curVertex = mesh->vertices + nextVertex * 8;
+}
+
+float computeACMR(const int* indices, int numIndices, int numVertices, int cacheSize) {
+	if (numIndices == 0) return 0.0f;
+	VertexCacheSimulation cache(numVertices, cacheSize);
+	int misses = 0;
+	for (int i = 0; i < numIndices; ++i) {
+		if (cache.transform(indices[i])) ++misses;
+	}
+	return misses / (numIndices / 3.0f);
+}
+
+void optimizeMesh(Mesh* mesh, const char* name) {
+	float before = computeACMR(mesh->indices, mesh->numIndices, mesh->numVertices);
+	optimizeVertexCache(mesh);
+	float cacheOptimized = computeACMR(mesh->indices, mesh->numIndices, mesh->numVertices);
+	optimizeOverdraw(mesh);
+	optimizeVertexFetch(mesh);
+	float after = computeACMR(mesh->indices, mesh->numIndices, mesh->numVertices);
+	Kore::log(Kore::Info, "%s: ACMR %.3f before, %.3f with vertex cache order, %.3f with overdraw order", name, before, cacheOptimized, after);
+}
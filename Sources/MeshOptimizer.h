@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+// Optimizations of the triangle and vertex order of a loaded mesh, to be run before the mesh is uploaded.
+// They only change the order, the mesh looks the same.
+
+// Reorders the triangles so that they reuse the vertices the GPU has just transformed (Tom Forsyth's linear-speed vertex cache optimisation)
+void optimizeVertexCache(Mesh* mesh);
+
+// Reorders clusters of triangles so that the ones facing outwards come first and hide what is behind them.
+// Run after optimizeVertexCache, the clusters are the runs of triangles that start with a cold cache
+void optimizeOverdraw(Mesh* mesh);
+
+// Renumbers the vertices in the order the triangles first use them, so the vertex fetch reads memory front to back.
+// Vertices no triangle uses are dropped
+void optimizeVertexFetch(Mesh* mesh);
+
+// Average cache miss ratio: vertices the GPU has to transform per triangle with a FIFO cache of cacheSize vertices.
+// 3 is the worst case, 0.5 is about the best a large regular mesh can get
+float computeACMR(const int* indices, int numIndices, int numVertices, int cacheSize = 16);
+
+// Runs all of the above and logs the ACMR before and after
+void optimizeMesh(Mesh* mesh, const char* name);
@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "NeighbourKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NEIGHBOUR_KERNEL_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define NEIGHBOUR_KERNEL_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NEIGHBOUR_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+	typedef unsigned (*Kernel)(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result);
+	
+	// Tests the candidates [start, count) one at a time, also used for the tails of the vector kernels
+	unsigned testScalar(const float* x, const float* y, unsigned start, unsigned count, const NeighbourQuery& query, unsigned* result)
+	{
+		unsigned found = 0;
+		for (unsigned i = start; i < count; ++i)
+		{
+			float dx = x[i] - query.x;
+			float dy = y[i] - query.y;
+			float distanceSquared = dx * dx + dy * dy;
+			if (!(distanceSquared <= query.radiusSquared)) continue;
+			if (query.useCone && !insideViewCone(query.lookX * dx + query.lookY * dy, distanceSquared, query.minDotProduct)) continue;
+			result[found++] = i;
+		}
+		return found;
+	}
+	
+	unsigned findScalar(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result)
+	{
+		return testScalar(x, y, 0, count, query, result);
+	}
+	
+	// Appends the indices of the set bits of a lane mask
+	inline unsigned compact(unsigned mask, unsigned base, unsigned* result)
+	{
+		unsigned found = 0;
+		for (unsigned lane = 0; mask != 0; ++lane, mask >>= 1)
+		{
+			if (mask & 1) result[found++] = base + lane;
+		}
+		return found;
+	}
+	
+#ifdef NEIGHBOUR_KERNEL_SSE2
+	unsigned findSSE2(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result)
+	{
+		const __m128 qx = _mm_set1_ps(query.x);
+		const __m128 qy = _mm_set1_ps(query.y);
+		const __m128 lookX = _mm_set1_ps(query.lookX);
+		const __m128 lookY = _mm_set1_ps(query.lookY);
+		const __m128 radiusSquared = _mm_set1_ps(query.radiusSquared);
+		const __m128 minDotSquared = _mm_set1_ps(query.minDotProduct * query.minDotProduct);
+		const __m128 zero = _mm_setzero_ps();
+		const bool forwardCone = query.minDotProduct >= 0.0f;
+		
+		unsigned found = 0;
+		unsigned i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), qx);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), qy);
+			__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			__m128 pass = _mm_cmple_ps(distanceSquared, radiusSquared);
+			if (query.useCone)
+			{
+				__m128 dot = _mm_add_ps(_mm_mul_ps(lookX, dx), _mm_mul_ps(lookY, dy));
+				__m128 dotSquared = _mm_mul_ps(dot, dot);
+				__m128 limit = _mm_mul_ps(minDotSquared, distanceSquared);
+				__m128 cone = forwardCone
+					? _mm_and_ps(_mm_cmpge_ps(dot, zero), _mm_cmpge_ps(dotSquared, limit))
+					: _mm_or_ps(_mm_cmpge_ps(dot, zero), _mm_cmple_ps(dotSquared, limit));
+				pass = _mm_and_ps(pass, cone);
+			}
+			found += compact((unsigned)_mm_movemask_ps(pass), i, result + found);
+		}
+		return found + testScalar(x, y, i, count, query, result + found);
+	}
+#endif
+	
+#ifdef NEIGHBOUR_KERNEL_AVX2
+#if defined(__GNUC__) || defined(__clang__)
+	__attribute__((target("avx2")))
+#endif
+	unsigned findAVX2(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result)
+	{
+		const __m256 qx = _mm256_set1_ps(query.x);
+		const __m256 qy = _mm256_set1_ps(query.y);
+		const __m256 lookX = _mm256_set1_ps(query.lookX);
+		const __m256 lookY = _mm256_set1_ps(query.lookY);
+		const __m256 radiusSquared = _mm256_set1_ps(query.radiusSquared);
+		const __m256 minDotSquared = _mm256_set1_ps(query.minDotProduct * query.minDotProduct);
+		const __m256 zero = _mm256_setzero_ps();
+		const bool forwardCone = query.minDotProduct >= 0.0f;
+		
+		unsigned found = 0;
+		unsigned i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), qx);
+			__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), qy);
+			__m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			__m256 pass = _mm256_cmp_ps(distanceSquared, radiusSquared, _CMP_LE_OQ);
+			if (query.useCone)
+			{
+				__m256 dot = _mm256_add_ps(_mm256_mul_ps(lookX, dx), _mm256_mul_ps(lookY, dy));
+				__m256 dotSquared = _mm256_mul_ps(dot, dot);
+				__m256 limit = _mm256_mul_ps(minDotSquared, distanceSquared);
+				__m256 cone = forwardCone
+					? _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_GE_OQ), _mm256_cmp_ps(dotSquared, limit, _CMP_GE_OQ))
+					: _mm256_or_ps(_mm256_cmp_ps(dot, zero, _CMP_GE_OQ), _mm256_cmp_ps(dotSquared, limit, _CMP_LE_OQ));
+				pass = _mm256_and_ps(pass, cone);
+			}
+			found += compact((unsigned)_mm256_movemask_ps(pass), i, result + found);
+		}
+		return found + testScalar(x, y, i, count, query, result + found);
+	}
+	
+	bool cpuHasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		// The OS has to save the AVX registers (OSXSAVE and the XCR0 YMM bits)
+		if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+	
+#ifdef NEIGHBOUR_KERNEL_NEON
+	unsigned findNEON(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result)
+	{
+		const float32x4_t qx = vdupq_n_f32(query.x);
+		const float32x4_t qy = vdupq_n_f32(query.y);
+		const float32x4_t lookX = vdupq_n_f32(query.lookX);
+		const float32x4_t lookY = vdupq_n_f32(query.lookY);
+		const float32x4_t radiusSquared = vdupq_n_f32(query.radiusSquared);
+		const float32x4_t minDotSquared = vdupq_n_f32(query.minDotProduct * query.minDotProduct);
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		const bool forwardCone = query.minDotProduct >= 0.0f;
+		
+		unsigned found = 0;
+		unsigned i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4_t dx = vsubq_f32(vld1q_f32(x + i), qx);
+			float32x4_t dy = vsubq_f32(vld1q_f32(y + i), qy);
+			float32x4_t distanceSquared = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+			uint32x4_t pass = vcleq_f32(distanceSquared, radiusSquared);
+			if (query.useCone)
+			{
+				float32x4_t dot = vaddq_f32(vmulq_f32(lookX, dx), vmulq_f32(lookY, dy));
+				float32x4_t dotSquared = vmulq_f32(dot, dot);
+				float32x4_t limit = vmulq_f32(minDotSquared, distanceSquared);
+				uint32x4_t cone = forwardCone
+					? vandq_u32(vcgeq_f32(dot, zero), vcgeq_f32(dotSquared, limit))
+					: vorrq_u32(vcgeq_f32(dot, zero), vcleq_f32(dotSquared, limit));
+				pass = vandq_u32(pass, cone);
+			}
+			unsigned lanes[4];
+			vst1q_u32(lanes, pass);
+			unsigned mask = (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+			found += compact(mask, i, result + found);
+		}
+		return found + testScalar(x, y, i, count, query, result + found);
+	}
+#endif
+	
+	struct KernelChoice
+	{
+		Kernel kernel;
+		const char* name;
+	};
+	
+	KernelChoice chooseKernel()
+	{
+		KernelChoice choice = { findScalar, "scalar" };
+#ifdef NEIGHBOUR_KERNEL_SSE2
+		choice.kernel = findSSE2;
+		choice.name = "SSE2";
+#endif
+#ifdef NEIGHBOUR_KERNEL_AVX2
+		if (cpuHasAVX2())
+		{
+			choice.kernel = findAVX2;
+			choice.name = "AVX2";
+		}
+#endif
+#ifdef NEIGHBOUR_KERNEL_NEON
+		choice.kernel = findNEON;
+		choice.name = "NEON";
+#endif
+		return choice;
+	}
+	
+	const KernelChoice& kernelChoice()
+	{
+		static const KernelChoice choice = chooseKernel();
+		return choice;
+	}
+}
+
+unsigned findNeighbours(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result)
+{
+	return kernelChoice().kernel(x, y, count, query, result);
+}
+
+const char* neighbourKernelName()
+{
+	return kernelChoice().name;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+* Describes a neighbourhood test: a candidate is a neighbour if it
+* lies within the radius around the center and, when useCone is
+* set, inside the view cone given by the look direction and the
+* minimum dot product.
+*/
+struct NeighbourQuery
+{
+	float x;
+	float y;
+	float lookX;
+	float lookY;
+	float radiusSquared;
+	float minDotProduct;
+	bool useCone;
+};
+
+/**
+* The view cone test without normalizing the offset. Checks
+* look.dot(offset) / |offset| >= minDotProduct using only the
+* squared length of the offset. A zero offset always passes.
+*/
+inline bool insideViewCone(float dotProduct, float distanceSquared, float minDotProduct)
+{
+	float limit = minDotProduct * minDotProduct * distanceSquared;
+	if (minDotProduct >= 0.0f)
+	{
+		return dotProduct >= 0.0f && dotProduct * dotProduct >= limit;
+	}
+	return dotProduct >= 0.0f || dotProduct * dotProduct <= limit;
+}
+
+/**
+* Tests the candidates given by the contiguous coordinate arrays x
+* and y against the query, 4 to 8 at a time where the CPU allows it.
+* Writes the indices of the candidates that pass into result in
+* ascending order and returns how many there are. result must have
+* room for count entries.
+*/
+unsigned findNeighbours(const float* x, const float* y, unsigned count, const NeighbourQuery& query, unsigned* result);
+
+/**
+* Returns the name of the kernel findNeighbours picked for this CPU.
+*/
+const char* neighbourKernelName();
@@ -1,104 +1,191 @@
 #include "pch.h"
 #include "ObjLoader.h"
 #include "Memory.h"
+#include "JobScheduler.h"
+#include "Profiler.h"
 #include <Kore/IO/FileReader.h>
 #include <cstring>
 #include <cstdlib>
 #include <assert.h>
+#include <vector>
 
 using namespace Kore;
 
 namespace {
-	const int maxTokenLength = 256;
+	// Powers of ten that are exact as doubles
+	const double exactPowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
 	
-	void tokenize(char* s, char delimiter, int& i, char* token) {
-		int lastIndex = i;
-		char* index = strchr(s + lastIndex + 1, delimiter);
-		if (index == nullptr) {
-			token[0] = 0;
-			return;
-		}
-		int newIndex = (int)(index - s);
-		i = newIndex;
-		int length = newIndex - lastIndex;
-		assert(length < maxTokenLength);
-		strncpy(token, s + lastIndex + 1, length);
-		token[length] = 0;
+	// Numbers with mantissas up to 2^53 are exact as doubles
+	const unsigned long long maxExactMantissa = 1ull << 53;
+	
+	// A line of the file, end points at the newline or the end of the file
+	struct Line {
+		const char* begin;
+		const char* end;
+	};
+	
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+	
+	bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+	
+	void skipSpaces(const char*& text, const char* end) {
+		while (text < end && isSpace(*text)) ++text;
+	}
+	
+	// Moves text to the start of the next line and returns the current one
+	Line nextLine(const char*& text, const char* end) {
+		Line line;
+		line.begin = text;
+		const char* newline = (const char*)memchr(text, '\n', end - text);
+		line.end = newline != nullptr ? newline : end;
+		text = newline != nullptr ? newline + 1 : end;
+		return line;
+	}
+	
+	// True if the line starts with command followed by a space
+	bool hasCommand(const Line& line, const char* command, size_t length) {
+		return line.end - line.begin > (ptrdiff_t)length && memcmp(line.begin, command, length) == 0 && isSpace(line.begin[length]);
 	}
 	
-	int countFirstCharLines(char* source, const char* start) {
+	// Counts the whitespace separated words in [text, end)
+	int countWords(const char* text, const char* end) {
 		int count = 0;
-		
-		int index = 0;
-		char line[maxTokenLength];
-		tokenize(source, '\n', index, line);
-		
-		while (line[0] != 0) {
-			char *pch = strstr(line, start);
-			if (pch == line)
-				count++;
-			tokenize(source, '\n', index, line);
+		while (true) {
+			skipSpaces(text, end);
+			if (text == end) return count;
+			++count;
+			while (text < end && !isSpace(*text)) ++text;
 		}
-		return count;
 	}
 	
-	int countFacesInLine(char* line) {
-		char* token = strtok(line, " ");
-		int i = -1;
-		while (token != nullptr) {
-			token = strtok(nullptr, " ");
-			i++;
-		}
-		
-		// For now, handle tris and quads
-		
-		if (i == 3) {
-			return 1;
+	// Parses a decimal integer and moves text behind it
+	int parseInt(const char*& text, const char* end) {
+		skipSpaces(text, end);
+		bool negative = false;
+		if (text < end && (*text == '-' || *text == '+')) {
+			negative = *text == '-';
+			++text;
 		}
-		else {
-			return 2;
+		int value = 0;
+		while (text < end && isDigit(*text)) {
+			value = value * 10 + (*text - '0');
+			++text;
 		}
+		return negative ? -value : value;
 	}
 	
-	int countFaces(char* source) {
-		int count = 0;
+	// Parses a number like 12, -0.5 or 1.5e-3 and moves text behind it.
+	// Returns the same value as (float)strtod, falls back to it for numbers that can not be computed exactly from a double mantissa
+	float parseFloat(const char*& text, const char* end) {
+		skipSpaces(text, end);
+		const char* start = text;
 		
-		int index = 0;
-		char line[maxTokenLength];
-		tokenize(source, '\n', index, line);
+		bool negative = false;
+		if (text < end && (*text == '-' || *text == '+')) {
+			negative = *text == '-';
+			++text;
+		}
 		
-		while (line[0] != 0) {
-			if (line[0] == 'f') {
-				count += countFacesInLine(line);
+		unsigned long long mantissa = 0;
+		int exponent = 0;
+		bool exact = true;
+		while (text < end && isDigit(*text)) {
+			if (mantissa < maxExactMantissa / 10) {
+				mantissa = mantissa * 10 + (*text - '0');
+			}
+			else {
+				exact = false;
 			}
-			tokenize(source, '\n', index, line);
+			++text;
+		}
+		if (text < end && *text == '.') {
+			++text;
+			while (text < end && isDigit(*text)) {
+				if (mantissa < maxExactMantissa / 10) {
+					mantissa = mantissa * 10 + (*text - '0');
+					--exponent;
+				}
+				else if (*text != '0') {
+					exact = false;
+				}
+				++text;
+			}
+		}
+		if (text < end && (*text == 'e' || *text == 'E')) {
+			++text;
+			exponent += parseInt(text, end);
+		}
+		
+		if (!exact || exponent < -22 || exponent > 22) {
+			// Rare in meshes, let the C library round these correctly
+			char buffer[64];
+			size_t length = text - start;
+			if (length >= sizeof(buffer)) length = sizeof(buffer) - 1;
+			memcpy(buffer, start, length);
+			buffer[length] = 0;
+			return (float)strtod(buffer, nullptr);
 		}
-		return count;
+		
+		double value = (double)mantissa;
+		if (exponent < 0) value /= exactPowersOfTen[-exponent];
+		else value *= exactPowersOfTen[exponent];
+		return (float)(negative ? -value : value);
 	}
 	
-	int countVertices(char* source) {
-		return countFirstCharLines(source, "v ");
-	}
+	// Marks a face corner without uv or normal
+	const int noAttribute = -1;
+	
+	// A corner of a face as written in the file, the indices start at 0
+	struct FaceCorner {
+		int vertex;
+		int uv;
+		int normal;
+	};
 	
-	int countNormals(char* source) {
-		return countFirstCharLines(source, "vn ");
+	// Parses a corner of a face: v, v/vt, v//vn or v/vt/vn
+	void parseFaceCorner(const char*& text, const char* end, FaceCorner& corner) {
+		corner.vertex = parseInt(text, end) - 1;
+		corner.uv = noAttribute;
+		corner.normal = noAttribute;
+		if (text < end && *text == '/') {
+			++text;
+			if (text < end && isDigit(*text)) corner.uv = parseInt(text, end) - 1;
+			if (text < end && *text == '/') {
+				++text;
+				if (text < end && isDigit(*text)) corner.normal = parseInt(text, end) - 1;
+			}
+		}
+		while (text < end && !isSpace(*text)) ++text;
 	}
 	
-	int countUVs(char* source) {
-		return countFirstCharLines(source, "vt ");
+	// Parses the corners of a face, returns 3 for a triangle and 4 for a quad
+	int parseFaceCorners(const char* text, const char* end, FaceCorner* corners) {
+		for (int i = 0; i < 3; i++) {
+			parseFaceCorner(text, end, corners[i]);
+		}
+		skipSpaces(text, end);
+		if (text < end) {
+			parseFaceCorner(text, end, corners[3]);
+			return 4;
+		}
+		return 3;
 	}
 	
-	void parseVertex(Mesh* mesh, char* line) {
-		char* token;
+	void parseVertex(Mesh* mesh, const char* text, const char* end) {
 		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			mesh->curVertex[i] = (float)strtod(token, nullptr);
+			mesh->curVertex[i] = parseFloat(text, end);
 		}
 		
-		mesh->curVertex += 3;
-		mesh->curVertex[0] = 0;
-		mesh->curVertex[1] = 0;
-		mesh->curVertex += 5;
+		mesh->curVertex[3] = 0;
+		mesh->curVertex[4] = 0;
+		mesh->curVertex[5] = 0;
+		mesh->curVertex[6] = 0;
+		mesh->curVertex[7] = 0;
+		mesh->curVertex += 8;
 		
 		mesh->numVertices++;
 	}
@@ -114,43 +201,31 @@ namespace {
 		mesh->vertices[(index * 8) + 7] = z;
 	}
 	
-	void parseFace(Mesh* mesh, char* line) {
-		char* token;
-		int verts[4];
-		int uvIndex[4];
-		int normalIndex[4];
-		bool hasUV[4];
-		bool hasNormal[4];
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			char* endPtr;
-			verts[i] = (int)strtol(token, &endPtr, 0) - 1;
-			if (endPtr[0] == '/') {
-				// Parse the uv
-				hasUV[i] = true;
-				uvIndex[i] = (int)strtol(endPtr + 1, &endPtr, 0) - 1;
-			} else {
-				// There is no uv
-				hasUV[i] = false;
-				hasNormal[i] = false;
-			}
-			if (endPtr[0] == '/') {
-				hasNormal[i] = true;
-				normalIndex[i] = (int)strtol(endPtr + 1, nullptr, 0) - 1;
-			}
-		}
-		token = strtok(nullptr, " ");
-		//char* result;
-		if (token != nullptr) {
-			verts[3] = (int)strtol(token, nullptr, 0) - 1;
+	// Copies the uv and normal of a corner into the vertex it uses.
+	// There is only one uv and normal per position, the last face that uses a position wins
+	void setCornerAttributes(Mesh* mesh, const FaceCorner& corner) {
+		if (corner.uv == noAttribute) return;
+		
+		// Set the UVs
+		setUV(mesh, corner.vertex, mesh->uvs[corner.uv * 2], mesh->uvs[(corner.uv * 2) + 1]);
+		
+		if (corner.normal == noAttribute) return;
+		
+		// Set the Normal
+		setNormal(mesh, corner.vertex, mesh->normals[corner.normal * 3], mesh->normals[corner.normal * 3 + 1], mesh->normals[corner.normal * 3 + 2]);
+	}
+	
+	// Appends the triangles of a face, a quad is split into two
+	void addFaceIndices(Mesh* mesh, const FaceCorner* corners, int count) {
+		if (count == 4) {
 			// We have a quad
-			mesh->curIndex[0] = verts[0];
-			mesh->curIndex[1] = verts[1];
-			mesh->curIndex[2] = verts[2];
+			mesh->curIndex[0] = corners[0].vertex;
+			mesh->curIndex[1] = corners[1].vertex;
+			mesh->curIndex[2] = corners[2].vertex;
 			mesh->curIndex += 3;
-			mesh->curIndex[0] = verts[2];
-			mesh->curIndex[1] = verts[3];
-			mesh->curIndex[2] = verts[0];
+			mesh->curIndex[0] = corners[2].vertex;
+			mesh->curIndex[1] = corners[3].vertex;
+			mesh->curIndex[2] = corners[0].vertex;
 			mesh->curIndex += 3;
 			mesh->numFaces += 2;
 			mesh->numIndices += 6;
@@ -158,17 +233,7 @@ namespace {
 		else {
 			// We have a triangle
 			for (int i = 0; i < 3; i++) {
-				mesh->curIndex[i] = verts[i];
-				
-				if (!hasUV[i]) continue;
-				
-				// Set the UVs
-				setUV(mesh, mesh->curIndex[i], mesh->uvs[uvIndex[i] * 2], mesh->uvs[(uvIndex[i] * 2) + 1]);
-				
-				if (!hasNormal[i]) continue;
-				
-				// Set the Normal
-				setNormal(mesh, mesh->curIndex[i], mesh->normals[normalIndex[i] * 3], mesh->normals[normalIndex[i] * 3 + 1], mesh->normals[normalIndex[i] * 3 + 2]);
+				mesh->curIndex[i] = corners[i].vertex;
 			}
 			mesh->curIndex += 3;
 			mesh->numFaces += 1;
@@ -176,79 +241,375 @@ namespace {
 		}
 	}
 	
-	void parseUV(Mesh* mesh, char* line) {
-		char* token;
+	void parseFace(Mesh* mesh, const char* text, const char* end) {
+		FaceCorner corners[4];
+		int count = parseFaceCorners(text, end, corners);
+		
+		// For now, only triangles get uvs and normals
+		if (count == 3) {
+			for (int i = 0; i < 3; i++) {
+				setCornerAttributes(mesh, corners[i]);
+			}
+		}
+		
+		addFaceIndices(mesh, corners, count);
+	}
+	
+	void parseUV(Mesh* mesh, const char* text, const char* end) {
 		for (int i = 0; i < 2; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curUV = (float)strtod(token, nullptr);
+			*mesh->curUV = parseFloat(text, end);
 			mesh->curUV++;
 		}
 	}
 	
-	void parseNormal(Mesh* mesh, char* line) {
-		char* token;
+	void parseNormal(Mesh* mesh, const char* text, const char* end) {
 		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curNormal = (float)strtod(token, nullptr);
+			*mesh->curNormal = parseFloat(text, end);
 			mesh->curNormal++;
 		}
 	}
 	
-	void parseLine(Mesh* mesh, char* line) {
-		char* token = strtok(line, " ");
-		if (strcmp(token, "v") == 0) {
+	void parseLine(Mesh* mesh, const Line& line) {
+		if (hasCommand(line, "v", 1)) {
 			// Read some vertex data
-			parseVertex(mesh, line);
+			parseVertex(mesh, line.begin + 1, line.end);
 		}
-		else if (strcmp(token, "f") == 0) {
+		else if (hasCommand(line, "f", 1)) {
 			// Read some face data
-			parseFace(mesh, line);
+			parseFace(mesh, line.begin + 1, line.end);
+		}
+		else if (hasCommand(line, "vt", 2)) {
+			parseUV(mesh, line.begin + 2, line.end);
 		}
-		else if (strcmp(token, "vt") == 0) {
-			parseUV(mesh, line);
-		} else if (strcmp(token, "vn") == 0) {
-			parseNormal(mesh, line);
+		else if (hasCommand(line, "vn", 2)) {
+			parseNormal(mesh, line.begin + 2, line.end);
 		}
 		
 		// Ignore all other commands (for now)
 	}
+	
+	// Counts the elements of every kind so the mesh can be allocated up front. Only looks at the start of each line, except for faces
+	void countElements(const char* text, const char* end, int& vertices, int& faces, int& uvs, int& normals) {
+		vertices = faces = uvs = normals = 0;
+		while (text < end) {
+			Line line = nextLine(text, end);
+			if (line.begin == line.end) continue;
+			if (line.begin[0] == 'v') {
+				if (hasCommand(line, "v", 1)) ++vertices;
+				else if (hasCommand(line, "vt", 2)) ++uvs;
+				else if (hasCommand(line, "vn", 2)) ++normals;
+			}
+			else if (hasCommand(line, "f", 1)) {
+				// For now, handle tris and quads
+				faces += countWords(line.begin + 1, line.end) == 3 ? 1 : 2;
+			}
+		}
+	}
+	
+	// Allocates the mesh with cursors at the start of every array
+	Mesh* allocateMesh(int vertices, int faces, int uvs, int normals) {
+		Mesh* mesh = Memory::allocateLevel<Mesh>(1, Memory::MeshMemory);
+		mesh->numIndices = 0;
+		mesh->vertices = Memory::allocateLevel<float>(vertices * 8, Memory::MeshMemory);
+		mesh->curVertex = mesh->vertices;
+		mesh->indices = Memory::allocateLevel<int>(faces * 3, Memory::MeshMemory);
+		mesh->curIndex = mesh->indices;
+		mesh->numUVs = uvs;
+		mesh->uvs = Memory::allocateLevel<float>(uvs * 2, Memory::MeshMemory);
+		mesh->curUV = mesh->uvs;
+		mesh->numNormals = normals;
+		mesh->normals = Memory::allocateLevel<float>(normals * 3, Memory::MeshMemory);
+		mesh->curNormal = mesh->normals;
+		
+		mesh->numVertices = 0;
+		mesh->numFaces = 0;
+		return mesh;
+	}
+	
+	// Files smaller than this are not worth splitting
+	const size_t minChunkSize = 256 * 1024;
+	
+	// Chunks per worker, so workers that finish early can steal the rest
+	const unsigned chunksPerWorker = 4;
+	
+	// A part of the file that ends at a newline
+	struct Chunk {
+		const char* begin;
+		const char* end;
+		
+		// The number of elements in the chunk, after the prefix sum the index of its first element of each kind
+		int vertices;
+		int faces;
+		int uvs;
+		int normals;
+	};
+	
+	struct ParallelParse {
+		Mesh* mesh;
+		std::vector<Chunk> chunks;
+		
+		// Where the positions go, 8 floats per vertex like in Mesh::vertices
+		float* positions;
+		
+		// Also remember the corners of quads, for welding
+		bool weld;
+		
+		// Three corners per triangle of the mesh in file order, for setting the uvs and normals after all chunks are parsed
+		std::vector<FaceCorner> corners;
+	};
+	
+	void countChunks(unsigned begin, unsigned end, unsigned, void* data) {
+		ParallelParse* parse = (ParallelParse*)data;
+		for (unsigned i = begin; i < end; ++i) {
+			Chunk& chunk = parse->chunks[i];
+			countElements(chunk.begin, chunk.end, chunk.vertices, chunk.faces, chunk.uvs, chunk.normals);
+		}
+	}
+	
+	void parseChunks(unsigned begin, unsigned end, unsigned, void* data) {
+		ParallelParse* parse = (ParallelParse*)data;
+		for (unsigned i = begin; i < end; ++i) {
+			const Chunk& chunk = parse->chunks[i];
+			
+			// Each chunk writes through its own cursors into its part of the arrays
+			Mesh cursor = *parse->mesh;
+			cursor.curVertex = parse->positions + chunk.vertices * 8;
+			cursor.curIndex = cursor.indices + chunk.faces * 3;
+			cursor.curUV = cursor.uvs + chunk.uvs * 2;
+			cursor.curNormal = cursor.normals + chunk.normals * 3;
+			FaceCorner* corner = &parse->corners[chunk.faces * 3];
+			
+			const char* text = chunk.begin;
+			while (text < chunk.end) {
+				Line line = nextLine(text, chunk.end);
+				if (!hasCommand(line, "f", 1)) {
+					parseLine(&cursor, line);
+					continue;
+				}
+				
+				// The uvs and normals a face uses may be in a later chunk, so only remember them for now
+				FaceCorner faceCorners[4];
+				int count = parseFaceCorners(line.begin + 1, line.end, faceCorners);
+				addFaceIndices(&cursor, faceCorners, count);
+				if (count == 3) {
+					corner[0] = faceCorners[0];
+					corner[1] = faceCorners[1];
+					corner[2] = faceCorners[2];
+					corner += 3;
+				}
+				else if (parse->weld) {
+					// In the same order as the indices of the two triangles
+					corner[0] = faceCorners[0];
+					corner[1] = faceCorners[1];
+					corner[2] = faceCorners[2];
+					corner[3] = faceCorners[2];
+					corner[4] = faceCorners[3];
+					corner[5] = faceCorners[0];
+					corner += 6;
+				}
+				else {
+					// For now, only triangles get uvs and normals
+					for (int j = 0; j < 6; ++j) {
+						corner->uv = noAttribute;
+						++corner;
+					}
+				}
+			}
+		}
+	}
+	
+	// Splits [source, end) into about count chunks that end at newlines
+	void splitChunks(const char* source, const char* end, unsigned count, std::vector<Chunk>& chunks) {
+		size_t size = end - source;
+		const char* begin = source;
+		for (unsigned i = 1; i <= count && begin < end; ++i) {
+			const char* split = i == count ? end : source + size / count * i;
+			if (split < begin) split = begin;
+			const char* newline = (const char*)memchr(split, '\n', end - split);
+			Chunk chunk;
+			chunk.begin = begin;
+			chunk.end = newline != nullptr ? newline + 1 : end;
+			chunks.push_back(chunk);
+			begin = chunk.end;
+		}
+	}
+	
+	// How many chunks a file of size bytes is split into
+	unsigned getChunkCount(size_t size, JobScheduler* scheduler) {
+		if (scheduler == nullptr) return 1;
+		unsigned count = scheduler->getWorkerCount() * chunksPerWorker;
+		if (size / minChunkSize < count) count = (unsigned)(size / minChunkSize);
+		return count > 1 ? count : 1;
+	}
+	
+	// Runs function for all chunks, on the scheduler's workers if there is one
+	void forChunks(ParallelParse& parse, JobScheduler* scheduler, JobScheduler::RangeFunction function) {
+		unsigned count = (unsigned)parse.chunks.size();
+		if (scheduler != nullptr) scheduler->parallelFor(count, 1, function, &parse);
+		else function(0, count, 0, &parse);
+	}
+	
+	// Counts the elements of all chunks and gives every chunk the index of its first element of each kind
+	void countChunked(ParallelParse& parse, JobScheduler* scheduler, int& vertices, int& faces, int& uvs, int& normals) {
+		forChunks(parse, scheduler, countChunks);
+		vertices = faces = uvs = normals = 0;
+		for (size_t i = 0; i < parse.chunks.size(); ++i) {
+			Chunk& chunk = parse.chunks[i];
+			int chunkVertices = chunk.vertices, chunkFaces = chunk.faces, chunkUVs = chunk.uvs, chunkNormals = chunk.normals;
+			chunk.vertices = vertices;
+			chunk.faces = faces;
+			chunk.uvs = uvs;
+			chunk.normals = normals;
+			vertices += chunkVertices;
+			faces += chunkFaces;
+			uvs += chunkUVs;
+			normals += chunkNormals;
+		}
+	}
+	
+	// Mixes the indices of a corner into a hash
+	unsigned hashCorner(const FaceCorner& corner) {
+		unsigned hash = (unsigned)corner.vertex * 0x9E3779B1u;
+		hash ^= (unsigned)corner.uv * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+		hash ^= (unsigned)corner.normal * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+		hash ^= hash >> 16;
+		hash *= 0x7FEB352Du;
+		hash ^= hash >> 15;
+		return hash;
+	}
+	
+	bool sameCorner(const FaceCorner& a, const FaceCorner& b) {
+		return a.vertex == b.vertex && a.uv == b.uv && a.normal == b.normal;
+	}
+	
+	// Creates one vertex per distinct position, uv and normal the corners use, in the order they are first used,
+	// and points the indices at them. Positions no face uses are dropped
+	void weldCorners(Mesh* mesh, const float* positions, const std::vector<FaceCorner>& corners) {
+		// Open addressing with linear probing, kept at most half full
+		size_t tableSize = 16;
+		while (tableSize < corners.size() * 2) tableSize *= 2;
+		const size_t mask = tableSize - 1;
+		const int empty = -1;
+		Memory::ScratchScope scope;
+		int* table = Memory::scratchPad<int>(tableSize);
+		for (size_t i = 0; i < tableSize; ++i) table[i] = empty;
+		
+		// At most one per corner
+		FaceCorner* unique = Memory::scratchPad<FaceCorner>(corners.size());
+		size_t uniqueCount = 0;
+		
+		for (size_t i = 0; i < corners.size(); ++i) {
+			const FaceCorner& corner = corners[i];
+			size_t slot = hashCorner(corner) & mask;
+			while (table[slot] != empty && !sameCorner(unique[table[slot]], corner)) {
+				slot = (slot + 1) & mask;
+			}
+			if (table[slot] == empty) {
+				table[slot] = (int)uniqueCount;
+				unique[uniqueCount++] = corner;
+			}
+			mesh->indices[i] = table[slot];
+		}
+		
+		mesh->numVertices = (int)uniqueCount;
+		mesh->vertices = Memory::allocateLevel<float>(uniqueCount * 8, Memory::MeshMemory);
+		for (size_t i = 0; i < uniqueCount; ++i) {
+			const FaceCorner& corner = unique[i];
+			float* vertex = &mesh->vertices[i * 8];
+			vertex[0] = positions[corner.vertex * 8 + 0];
+			vertex[1] = positions[corner.vertex * 8 + 1];
+			vertex[2] = positions[corner.vertex * 8 + 2];
+			vertex[3] = corner.uv != noAttribute ? mesh->uvs[corner.uv * 2] : 0.0f;
+			vertex[4] = corner.uv != noAttribute ? mesh->uvs[corner.uv * 2 + 1] : 0.0f;
+			vertex[5] = corner.normal != noAttribute ? mesh->normals[corner.normal * 3] : 0.0f;
+			vertex[6] = corner.normal != noAttribute ? mesh->normals[corner.normal * 3 + 1] : 0.0f;
+			vertex[7] = corner.normal != noAttribute ? mesh->normals[corner.normal * 3 + 2] : 0.0f;
+		}
+		mesh->curVertex = mesh->vertices + uniqueCount * 8;
+	}
+	
+	Mesh* parseObj(const char* source, const char* end) {
+		int vertices, faces, uvs, normals;
+		countElements(source, end, vertices, faces, uvs, normals);
+		
+		Mesh* mesh = allocateMesh(vertices, faces, uvs, normals);
+		
+		const char* text = source;
+		while (text < end) {
+			parseLine(mesh, nextLine(text, end));
+		}
+		
+		assert(mesh->numVertices == vertices && mesh->numFaces == faces);
+		return mesh;
+	}
 }
 
 Mesh* loadObj(const char* filename) {
+	PROFILE_ZONE("loadObj");
+	FileReader fileReader(filename, FileReader::Asset);
+	const char* source = (const char*)fileReader.readAll();
+	return parseObj(source, source + fileReader.size());
+}
+
+Mesh* loadObj(const char* filename, JobScheduler* scheduler) {
+	PROFILE_ZONE("loadObj parallel");
 	FileReader fileReader(filename, FileReader::Asset);
-	void* data = fileReader.readAll();
-	int length = fileReader.size() + 1;
-	char* source = Memory::scratchPad<char>(length);
-	memcpy(source, data, length);
-	source[length] = 0;
-	
-	Mesh* mesh = Memory::allocate<Mesh>();
-	mesh->numIndices = 0;
-	int vertices = countVertices(source);
-	mesh->vertices = Memory::allocate<float>(vertices * 8);
-	mesh->curVertex = mesh->vertices;
-	int faces = countFaces(source);
-	mesh->indices = Memory::allocate<int>(faces * 3);
-	mesh->curIndex = mesh->indices;
-	mesh->numUVs = countUVs(source);
-	mesh->uvs = Memory::allocate<float>(mesh->numUVs * 2);
-	mesh->curUV = mesh->uvs;
-	int normals = countNormals(source);
-	mesh->numNormals = normals;
-	mesh->normals = Memory::allocate<float>(normals * 3);
-	mesh->curNormal = mesh->normals;
-	
-	mesh->numVertices = 0;
-	mesh->numFaces = 0;
-	
-	int index = 0;
-	char line[maxTokenLength];
-	tokenize(source, '\n', index, line);
-	
-	while (line[0] != 0) {
-		parseLine(mesh, line);
-		tokenize(source, '\n', index, line);
+	const char* source = (const char*)fileReader.readAll();
+	const char* end = source + fileReader.size();
+	
+	unsigned chunkCount = getChunkCount(end - source, scheduler);
+	if (chunkCount == 1) return parseObj(source, end);
+	
+	ParallelParse parse;
+	parse.weld = false;
+	splitChunks(source, end, chunkCount, parse.chunks);
+	
+	int vertices, faces, uvs, normals;
+	countChunked(parse, scheduler, vertices, faces, uvs, normals);
+	
+	parse.mesh = allocateMesh(vertices, faces, uvs, normals);
+	parse.positions = parse.mesh->vertices;
+	parse.corners.resize(faces * 3);
+	forChunks(parse, scheduler, parseChunks);
+	
+	Mesh* mesh = parse.mesh;
+	mesh->numVertices = vertices;
+	mesh->numFaces = faces;
+	mesh->numIndices = faces * 3;
+	
+	// In file order so a position shared by several triangles ends up with the same uv and normal as with loadObj(filename)
+	for (size_t i = 0; i < parse.corners.size(); ++i) {
+		setCornerAttributes(mesh, parse.corners[i]);
 	}
 	
 	return mesh;
 }
+
+Mesh* loadObjWelded(const char* filename, JobScheduler* scheduler) {
+	PROFILE_ZONE("loadObjWelded");
+	FileReader fileReader(filename, FileReader::Asset);
+	const char* source = (const char*)fileReader.readAll();
+	const char* end = source + fileReader.size();
+	
+	ParallelParse parse;
+	parse.weld = true;
+	splitChunks(source, end, getChunkCount(end - source, scheduler), parse.chunks);
+	
+	int vertices, faces, uvs, normals;
+	countChunked(parse, scheduler, vertices, faces, uvs, normals);
+	
+	// The positions are only needed until the vertices are welded
+	Memory::ScratchScope scope;
+	float* positions = Memory::scratchPad<float>(vertices * 8);
+	parse.mesh = allocateMesh(0, faces, uvs, normals);
+	parse.positions = positions;
+	parse.corners.resize(faces * 3);
+	forChunks(parse, scheduler, parseChunks);
+	
+	Mesh* mesh = parse.mesh;
+	mesh->numFaces = faces;
+	mesh->numIndices = faces * 3;
+	weldCorners(mesh, positions, parse.corners);
+	
+	return mesh;
+}
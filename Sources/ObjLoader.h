@@ -19,4 +19,15 @@ struct Mesh {
 	float* curNormal;
 };
 
+class JobScheduler;
+
+// The meshes are allocated in level memory and live until Memory::resetLevel
 Mesh* loadObj(const char* filename);
+
+// Parses large files in chunks on the scheduler's workers, gives the same mesh as loadObj(filename)
+// Uses scheduler->parallelFor, so only call it on the thread that owns the scheduler
+Mesh* loadObj(const char* filename, JobScheduler* scheduler);
+
+// Creates one vertex per distinct combination of position, uv and normal the faces use, so every corner,
+// also of quads, gets its own uv and normal. Parses in parallel like loadObj if there is a scheduler
+Mesh* loadObjWelded(const char* filename, JobScheduler* scheduler = nullptr);
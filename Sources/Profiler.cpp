@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+std::atomic<bool> Profiler::enabled(false);
+
+namespace {
+	// Zones per thread, 24 bytes each
+	const unsigned long long bufferSize = 64 * 1024;
+
+	struct ZoneRecord {
+		const char* name;
+		unsigned long long begin;
+		unsigned long long end;
+	};
+
+	// Written only by its thread. count is published after the zone, so a reader sees complete zones unless they are overwritten meanwhile
+	struct ThreadBuffer {
+		ThreadBuffer() : count(0), zones(bufferSize) {}
+
+		std::atomic<unsigned long long> count;
+		std::vector<ZoneRecord> zones;
+	};
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Buffers are kept after their thread ends, so its zones can still be written
+	std::vector<ThreadBuffer*> buffers;
+	std::mutex buffersMutex;
+
+	ThreadBuffer* getThreadBuffer() {
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			buffer = new ThreadBuffer;
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			buffers.push_back(buffer);
+		}
+		return buffer;
+	}
+}
+
+void Profiler::setEnabled(bool enable) {
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+unsigned long long Profiler::now() {
+	// Never 0, that marks zones that started while recording was off
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() + 1;
+}
+
+void Profiler::record(const char* name, unsigned long long begin, unsigned long long end) {
+	ThreadBuffer* buffer = getThreadBuffer();
+	unsigned long long count = buffer->count.load(std::memory_order_relaxed);
+	ZoneRecord& zone = buffer->zones[count % bufferSize];
+	zone.name = name;
+	zone.begin = begin;
+	zone.end = end;
+	buffer->count.store(count + 1, std::memory_order_release);
+}
+
+bool Profiler::writeChromeTrace(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) return false;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t thread = 0; thread < buffers.size(); ++thread) {
+		const ThreadBuffer* buffer = buffers[thread];
+		unsigned long long count = buffer->count.load(std::memory_order_acquire);
+		unsigned long long oldest = count > bufferSize ? count - bufferSize : 0;
+		for (unsigned long long i = oldest; i < count; ++i) {
+			const ZoneRecord& zone = buffer->zones[i % bufferSize];
+			// Complete events, in microseconds
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+				zone.name, (int)thread, zone.begin / 1000.0, (zone.end - zone.begin) / 1000.0);
+			first = false;
+		}
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(file) == 0;
+}
+
+void Profiler::clear() {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		buffers[i]->count.store(0, std::memory_order_relaxed);
+	}
+}
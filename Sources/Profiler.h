@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+
+// Scoped timing zones. Every thread records into its own ring buffer without locks, the newest zones overwrite the oldest.
+// While recording is off a zone costs one relaxed load and a branch. Build with EXERCISE_NO_PROFILER to compile the zones out.
+// Usage: PROFILE_ZONE("updateAI"); at the start of a block. The name has to stay valid, use string literals
+namespace Profiler {
+	extern std::atomic<bool> enabled;
+
+	inline bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	void setEnabled(bool enable);
+
+	// Nanoseconds since the profiler started
+	unsigned long long now();
+
+	// Adds a finished zone to the calling thread's buffer
+	void record(const char* name, unsigned long long begin, unsigned long long end);
+
+	// Writes the recorded zones of all threads in the Chrome trace event format, for chrome://tracing and Perfetto.
+	// Call it while recording is off or no thread records, zones written meanwhile may be torn
+	bool writeChromeTrace(const char* filename);
+
+	// Drops the recorded zones, with the same restriction as writeChromeTrace
+	void clear();
+
+	class Zone {
+	public:
+		explicit Zone(const char* name) : name(name), begin(isEnabled() ? now() : 0) {}
+
+		~Zone() {
+			if (begin != 0) record(name, begin, now());
+		}
+
+	private:
+		Zone(const Zone&);
+		Zone& operator=(const Zone&);
+
+		const char* name;
+		unsigned long long begin;
+	};
+}
+
+#define PROFILE_CONCATENATE_(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_(a, b)
+
+#ifdef EXERCISE_NO_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCATENATE(profileZone, __LINE__)(name)
+#endif
@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "RenderQueue.h"
+
+#include <Kore/Math/Core.h>
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+using namespace Kore;
+
+namespace
+{
+	// TextureUnit is a plain struct of the graphics backend without comparison operators
+	int compareTextureUnits(const Graphics4::TextureUnit& a, const Graphics4::TextureUnit& b)
+	{
+		return memcmp(&a, &b, sizeof(Graphics4::TextureUnit));
+	}
+}
+
+RenderQueue::RenderQueue()
+:
+drawCalls(0), stateChanges(0)
+{
+	instanceStructure.add("M", Graphics4::Float4x4VertexData);
+}
+
+RenderQueue::~RenderQueue()
+{
+	for (unsigned i = 0; i < instanceBuffers.size(); ++i)
+	{
+		delete instanceBuffers[i].buffer;
+	}
+}
+
+Graphics4::VertexStructure& RenderQueue::getInstanceStructure()
+{
+	return instanceStructure;
+}
+
+void RenderQueue::add(Graphics4::PipelineState* pipeline, Graphics4::TextureUnit textureUnit, Graphics4::Texture* texture,
+	Graphics4::VertexBuffer* vertexBuffer, Graphics4::IndexBuffer* indexBuffer, const mat4& M)
+{
+	DrawItem item;
+	item.pipeline = pipeline;
+	item.textureUnit = textureUnit;
+	item.texture = texture;
+	item.vertexBuffer = vertexBuffer;
+	item.indexBuffer = indexBuffer;
+	item.M = M;
+	items.push_back(item);
+}
+
+bool RenderQueue::sameState(const DrawItem& a, const DrawItem& b)
+{
+	return a.pipeline == b.pipeline && compareTextureUnits(a.textureUnit, b.textureUnit) == 0 && a.texture == b.texture
+		&& a.vertexBuffer == b.vertexBuffer && a.indexBuffer == b.indexBuffer;
+}
+
+bool RenderQueue::drawsBefore(const DrawItem& a, const DrawItem& b)
+{
+	// Pipeline changes are the most expensive, so they come first. The pointers only have to give some order
+	std::less<const void*> less;
+	if (a.pipeline != b.pipeline) return less(a.pipeline, b.pipeline);
+	const int textureUnitOrder = compareTextureUnits(a.textureUnit, b.textureUnit);
+	if (textureUnitOrder != 0) return textureUnitOrder < 0;
+	if (a.texture != b.texture) return less(a.texture, b.texture);
+	if (a.vertexBuffer != b.vertexBuffer) return less(a.vertexBuffer, b.vertexBuffer);
+	return less(a.indexBuffer, b.indexBuffer);
+}
+
+Graphics4::VertexBuffer* RenderQueue::getInstanceBuffer(unsigned batch, int count)
+{
+	if (batch == instanceBuffers.size())
+	{
+		InstanceBuffer instances;
+		instances.buffer = nullptr;
+		instances.capacity = 0;
+		instanceBuffers.push_back(instances);
+	}
+
+	InstanceBuffer& instances = instanceBuffers[batch];
+	if (count > instances.capacity)
+	{
+		delete instances.buffer;
+		instances.capacity = Kore::max(count, instances.capacity * 2);
+		instances.buffer = new Graphics4::VertexBuffer(instances.capacity, instanceStructure, 1);
+	}
+	return instances.buffer;
+}
+
+void RenderQueue::submit(PipelineCallback setConstants)
+{
+	drawCalls = 0;
+	stateChanges = 0;
+
+	// Sort indices instead of the items, the matrices make them large. Stable, so equal draws keep the order they were added in
+	order.resize(items.size());
+	for (unsigned i = 0; i < order.size(); ++i) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this](unsigned a, unsigned b) { return drawsBefore(items[a], items[b]); });
+
+	const DrawItem* last = nullptr;
+	unsigned batch = 0;
+	for (unsigned first = 0; first < order.size(); ++batch)
+	{
+		const DrawItem& item = items[order[first]];
+		unsigned end = first + 1;
+		while (end < order.size() && sameState(item, items[order[end]])) ++end;
+		const int count = end - first;
+
+		bool pipelineChanged = last == nullptr || last->pipeline != item.pipeline;
+		if (pipelineChanged)
+		{
+			Graphics4::setPipeline(item.pipeline);
+			if (setConstants != nullptr) setConstants(item.pipeline);
+			++stateChanges;
+		}
+		if (pipelineChanged || compareTextureUnits(last->textureUnit, item.textureUnit) != 0 || last->texture != item.texture)
+		{
+			Graphics4::setTexture(item.textureUnit, item.texture);
+			++stateChanges;
+		}
+		if (pipelineChanged || last->indexBuffer != item.indexBuffer)
+		{
+			Graphics4::setIndexBuffer(*item.indexBuffer);
+			++stateChanges;
+		}
+
+		// Column by column, like a mat4 attribute expects it
+		Graphics4::VertexBuffer* instances = getInstanceBuffer(batch, count);
+		float* data = instances->lock();
+		for (int i = 0; i < count; ++i)
+		{
+			const mat4& M = items[order[first + i]].M;
+			for (int column = 0; column < 4; ++column)
+			{
+				for (int row = 0; row < 4; ++row)
+				{
+					data[i * 16 + column * 4 + row] = M.get(row, column);
+				}
+			}
+		}
+		instances->unlock();
+
+		// The instance buffer is new for every batch, so the vertex buffers are always set
+		Graphics4::VertexBuffer* buffers[] = { item.vertexBuffer, instances };
+		Graphics4::setVertexBuffers(buffers, 2);
+		Graphics4::drawIndexedVerticesInstanced(count);
+		++drawCalls;
+
+		last = &item;
+		first = end;
+	}
+
+	items.clear();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Kore/Graphics4/Graphics.h>
+#include <Kore/Graphics4/PipelineState.h>
+#include <Kore/Math/Matrix.h>
+
+#include <vector>
+
+/**
+* Collects the draws of a frame and submits them with as few state
+* changes and draw calls as possible.
+*
+* The draws are sorted by pipeline, texture and buffers. Draws with
+* the same state become one instanced call, their model matrices go
+* into the second vertex stream (see getInstanceStructure). Pipelines,
+* textures and index buffers are only set when they change.
+*
+* Usage per frame: add every visible object, then submit.
+*/
+class RenderQueue
+{
+public:
+	/**
+	* Called after a pipeline is set, to set its constants.
+	*/
+	typedef void (*PipelineCallback)(Kore::Graphics4::PipelineState* pipeline);
+
+	RenderQueue();
+	~RenderQueue();
+
+	/**
+	* The layout of the per-instance vertex stream, for inputLayout[1]
+	* of the pipelines. It holds the model matrix "M".
+	*/
+	Kore::Graphics4::VertexStructure& getInstanceStructure();
+
+	void add(Kore::Graphics4::PipelineState* pipeline, Kore::Graphics4::TextureUnit textureUnit, Kore::Graphics4::Texture* texture,
+		Kore::Graphics4::VertexBuffer* vertexBuffer, Kore::Graphics4::IndexBuffer* indexBuffer, const Kore::mat4& M);
+
+	/**
+	* Draws everything that was added and empties the queue.
+	*/
+	void submit(PipelineCallback setConstants);
+
+	/**
+	* The number of draw calls and of pipeline, texture and buffer
+	* changes of the last submit.
+	*/
+	int drawCalls;
+	int stateChanges;
+
+private:
+	RenderQueue(const RenderQueue&);
+	RenderQueue& operator=(const RenderQueue&);
+
+	struct DrawItem
+	{
+		Kore::Graphics4::PipelineState* pipeline;
+		Kore::Graphics4::TextureUnit textureUnit;
+		Kore::Graphics4::Texture* texture;
+		Kore::Graphics4::VertexBuffer* vertexBuffer;
+		Kore::Graphics4::IndexBuffer* indexBuffer;
+		Kore::mat4 M;
+	};
+
+	// Each batch of a frame gets its own buffer, so a buffer is not
+	// overwritten while an earlier draw may still read it
+	struct InstanceBuffer
+	{
+		Kore::Graphics4::VertexBuffer* buffer;
+		int capacity;
+	};
+
+	static bool sameState(const DrawItem& a, const DrawItem& b);
+	static bool drawsBefore(const DrawItem& a, const DrawItem& b);
+
+	Kore::Graphics4::VertexBuffer* getInstanceBuffer(unsigned batch, int count);
+
+	Kore::Graphics4::VertexStructure instanceStructure;
+
+	// Kept across frames so the vectors keep their memory
+	std::vector<DrawItem> items;
+	std::vector<unsigned> order;
+	std::vector<InstanceBuffer> instanceBuffers;
+};
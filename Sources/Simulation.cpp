@@ -0,0 +1,534 @@
+#include "pch.h"
+
+#include "Simulation.h"
+
+#include <Kore/Math/Core.h>
+#include <Kore/Log.h>
+
+#include "Flocking.h"
+#include "StateMachine.h"
+#include "BatchStateMachine.h"
+#include "CompiledStateMachine.h"
+#include "JobScheduler.h"
+#include "Profiler.h"
+
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	using Simulation::worldSize;
+	
+	// Trims the input variable to be inside the world size
+	void TrimWorld(float& x)
+	{
+		if (x < -worldSize) x = worldSize;
+		if (x > worldSize) x = -worldSize;
+	}
+	
+	// The boids in the simulation
+	std::vector<AICharacter*> boids;
+	
+	// Number of boids a thread updates in one go
+	const unsigned boidBatchSize = 64;
+	
+	// Runs the AI tick as a graph of jobs
+	JobScheduler* aiScheduler;
+	
+	// Scratch memory of one boid update thread
+	struct BoidWorkerScratch {
+		NeighbourScratch search;
+		std::vector<unsigned> neighbours;
+	};
+	std::vector<BoidWorkerScratch> workerScratch;
+	
+	// AI Characters for the moon and the Earth
+	AICharacter* moon;
+	AICharacter* earth;
+	
+	// Management for the whole flock
+	Flock flock;
+	
+	// The largest neighbourhood size of the flocking behaviours, used as the grid cell size
+	const float maxNeighbourhoodSize = 2.0f;
+	
+	// Flock steering component, blends the three involved delegated steering behaviours in a single pass over the flock
+	FlockingSteering* flockSteering;
+	
+	// The settings of the three steering components that flockSteering blends together
+	Separation* separation;
+	Cohesion* cohesion;
+	VelocityMatchAndAlign* vMA;
+	
+	// Vector to hold steering information from the player
+	vec2 deltaPosition;
+	
+	// The two behaviours for the moon AI - wander and seek
+	Wander* wander;
+	Seek* seek;
+	
+	// The current steering behaviour for the moon
+	SteeringBehaviour* moonBehaviour;
+	
+	// State machine for the moon's behaviour
+	StateMachine moonStateMachine;
+	
+	// The same machine for Settings::BatchedMachine and Settings::CompiledMachine
+	Simulation::MachineKind moonMachine;
+	StateMachineDefinition* moonDefinition;
+	StateMachineBatch* moonBatch;
+	CompiledStateMachine* moonCompiled;
+	unsigned short moonCompiledState;
+	std::vector<CompiledStateMachine::Firing> moonFirings;
+	
+	// State for managing actions in the state machine
+	enum State { Wandering, Following };
+	
+	
+	// An action that can change the behaviour of the moon AI
+	class MoonAction : public Action {
+	public:
+		State state;
+		
+		virtual void act() {
+			if (state == Following) {
+				moonBehaviour = seek;
+				Kore::log(Kore::Info, "Moon is now seeking");
+			}
+			else {
+				moonBehaviour = wander;
+				Kore::log(Kore::Info, "Moon is now wandering");
+			}
+		}
+	};
+	
+	// A state in the moon's state machine. Returns the appropriate MoonAction to switch the state as the entry action
+	class MoonState : public StateMachineState
+	{
+	public:
+		
+		State state;
+		
+		virtual Action* getEntryActions() {
+			MoonAction* changeStatusAction = createFrameAction<MoonAction>();
+			changeStatusAction->state = state;
+			return changeStatusAction;
+		}
+		
+		virtual Action* getExitActions() {
+			return nullptr;
+		}
+	};
+	
+	
+	// A transition for the Moon's state machine.
+	// Is realized as a fixed target transition with a condition
+	class MoonTransition :
+	public Transition,
+	public ConditionalTransitionMixin,
+	public FixedTargetTransitionMixin
+	{
+	public:
+		
+		virtual Action* getActions() {
+			return nullptr;
+		}
+		
+		virtual bool isTriggered() {
+			bool result = ConditionalTransitionMixin::isTriggered();
+			return result;
+		}
+		
+		StateMachineState* getTargetState()
+		{
+			return FixedTargetTransitionMixin::getTargetState();
+		}
+	};
+	
+	/************************************************************************/
+	// Task P13.2a: Complete this class so that it correctly returns
+	// Checks if the moon is closer or further away from the specified distance
+	/************************************************************************/
+	class MoonCondition : public Condition {
+	public:
+		float transitionDistance;
+		
+		bool checkIfCloser;
+		
+		AICharacter* earthCharacter;
+		
+		AICharacter* moonCharacter;
+		
+		bool lastResult;
+		
+		/**
+		 * Performs the test for this condition.
+		 */
+		virtual bool test() {
+			float distance = earthCharacter->Position.distance(moonCharacter->Position);
+			bool result;
+			
+			if (checkIfCloser) {
+				result = (distance < transitionDistance);
+				if (result != lastResult) {
+					if (checkIfCloser) {
+						Kore::log(Kore::Info, "checkIfCloser TRUE:");
+					}
+					else {
+						Kore::log(Kore::Info, "checkIfCloser FALSE:");
+					}
+					if (result) {
+						Kore::log(Kore::Info, "Moon is closer than distance");
+					}
+					else {
+						Kore::log(Kore::Info, "Moon is further than distance");
+					}
+				}
+			}
+			else {
+				result = (distance >= transitionDistance);
+				if (result != lastResult) {
+					if (checkIfCloser) {
+						Kore::log(Kore::Info, "checkIfCloser TRUE:");
+					}
+					else {
+						Kore::log(Kore::Info, "checkIfCloser FALSE:");
+					}
+					if (result) {
+						Kore::log(Kore::Info, "Moon is further than distance");
+					}
+					else {
+						Kore::log(Kore::Info, "Moon is closer than distance");
+					}
+				}
+			}
+			lastResult = result;
+			return result;
+		}
+	};
+	
+	// Updates the boids [begin, end) for the duration that data points to.
+	// Reads the previous state from the flock's arrays and writes the new state into the boids, so the boids can be updated in any order and in parallel
+	void updateBoids(unsigned begin, unsigned end, unsigned worker, void* data) {
+		PROFILE_ZONE("updateBoids");
+		float duration = *(float*)data;
+		BoidWorkerScratch& scratch = workerScratch[worker];
+		SteeringOutput steer;
+		
+		for (unsigned i = begin; i < end; i++) {
+			AICharacter* boid = boids[i];
+			
+			// Get the steering output
+			flockSteering->getSteering(i, scratch.search, scratch.neighbours, &steer);
+			
+			// Update the kinematic
+			boid->integrate(steer, 0.7f, duration);
+			
+			// Face the direction we are moving
+			boid->setOrientationFromVelocity();
+			
+			// Check for maximum speed
+			boid->trimMaxSpeed(4.0f);
+			
+			// Keep in bounds of the world
+			TrimWorld(boid->Position[0]);
+			TrimWorld(boid->Position[1]);
+		}
+	}
+	
+	// The duration of the current AI tick and the moon's steering, shared by the jobs of the tick
+	float tickDuration;
+	SteeringOutput moonSteer;
+	
+	// The batched and compiled machines only report the state changes, so they run the entry action of the new state like the moon's StateMachine does
+	void enterMoonState(State state) {
+		MoonAction action;
+		action.next = nullptr;
+		action.state = state;
+		action.act();
+	}
+	
+	// Job: updates the state machine and executes its actions
+	void updateMoonStateMachine(void*) {
+		PROFILE_ZONE("moonStateMachine");
+		
+		if (moonMachine == Simulation::BatchedMachine) {
+			const std::vector<StateMachineBatch::StateChange>& changes = moonBatch->update();
+			for (unsigned i = 0; i < changes.size(); i++) {
+				enterMoonState((State)changes[i].to);
+			}
+			return;
+		}
+		
+		if (moonMachine == Simulation::CompiledMachine) {
+			// The action ids of the transitions are the states they enter
+			moonFirings.clear();
+			moonCompiled->update(&moonCompiledState, 1, moonFirings);
+			for (unsigned i = 0; i < moonFirings.size(); i++) {
+				const unsigned* actions = moonCompiled->getActions(moonFirings[i].transition);
+				for (unsigned a = 0; a < moonCompiled->getTransition(moonFirings[i].transition).actionCount; a++) {
+					enterMoonState((State)actions[a]);
+				}
+			}
+			return;
+		}
+		
+		// Get the actions that should be executed
+		Action* actions = moonStateMachine.update();
+		
+		// Execute any actions that should be executed
+		while (actions != nullptr) {
+			actions->act();
+			actions = actions->next;
+		}
+	}
+	
+	// Job: works out the moon's steering with the behaviour the state machine chose
+	void updateMoonSteering(void*) {
+		PROFILE_ZONE("moonSteering");
+		moonBehaviour->getSteering(&moonSteer);
+	}
+	
+	// Job: moves the moon
+	void integrateMoon(void*) {
+		moon->integrate(moonSteer, 0.95f, tickDuration);
+		moon->trimMaxSpeed(1.0f);
+		
+		// Keep in bounds of the world
+		TrimWorld(moon->Position[0]);
+		TrimWorld(moon->Position[1]);
+	}
+	
+	// Job: moves the earth
+	void integrateEarth(void*) {
+		// Treat player input as a steering output
+		SteeringOutput steer;
+		steer.clear();
+		steer.linear = deltaPosition;
+		steer.linear *= 10.0f;
+		earth->integrate(steer, 0.95f, tickDuration);
+		
+		earth->trimMaxSpeed(3.0f);
+		
+		// Keep in bounds of the world
+		TrimWorld(earth->Position[0]);
+		TrimWorld(earth->Position[1]);
+	}
+	
+	// Job: snapshots the state of the flock in its arrays and indexes it, the cells must be as large as the largest neighbourhood
+	void snapshotFlock(void*) {
+		PROFILE_ZONE("snapshotFlock");
+		flock.buildGrid(worldSize, maxNeighbourhoodSize);
+	}
+}
+
+Simulation::Settings::Settings() : boidCount(20), seed(42), threadCount(0), deterministic(false), moonMachine(ObjectMachine) {}
+
+void Simulation::init(const Settings& settings) {
+	// Set up Earth and moon AI characters
+	Kore::Random::init(settings.seed);
+	
+	moon = new AICharacter();
+	moon->Position = vec2(1.0f, 1.0f);
+	
+	earth = new AICharacter();
+	
+	// Set up the moon's behaviours
+	wander = new Wander();
+	wander->character = moon;
+	wander->maxAcceleration = 2.0f;
+	wander->turnSpeed = 2.0f;
+	wander->volatility = 20.0f;
+	
+	seek = new Seek();
+	seek->character = moon;
+	seek->maxAcceleration = 3.0f;
+	seek->target = &(earth->Position);
+	
+	moonBehaviour = wander;
+	
+	// Set up the moon's state machine
+	MoonState* wanderState = new MoonState();
+	MoonState* followState = new MoonState();
+	wanderState->state = Wandering;
+	followState->state = Following;
+	
+	MoonTransition* WanderingToFollowing = new MoonTransition();
+	WanderingToFollowing->target = followState;
+	
+	MoonTransition* FollowingToWandering = new MoonTransition();
+	FollowingToWandering->target = wanderState;
+	
+	/************************************************************************/
+	// Task 13.2b: After you have completed the MoonCondition object, instantiate it here
+	/************************************************************************/
+	
+	MoonCondition* ShouldFollow = new MoonCondition();
+	// This condition should trigger if the moon is closer than 1 unit to the Earth
+	ShouldFollow->checkIfCloser = true;
+	ShouldFollow->earthCharacter = earth;
+	ShouldFollow->moonCharacter = moon;
+	ShouldFollow->transitionDistance = 1.0f;
+	
+	MoonCondition* ShouldWander = new MoonCondition();
+	// This condition should trigger if the moon is further away than 1 unit from the Earth
+	ShouldWander->checkIfCloser = false;
+	ShouldWander->earthCharacter = earth;
+	ShouldWander->moonCharacter = moon;
+	ShouldWander->transitionDistance = 1.0f;
+	
+	
+	
+	
+	WanderingToFollowing->condition = ShouldFollow;
+	FollowingToWandering->condition = ShouldWander;
+	
+	wanderState->firstTransition = WanderingToFollowing;
+	followState->firstTransition = FollowingToWandering;
+	
+	moonStateMachine.initialState = wanderState;
+	moonStateMachine.currentState = wanderState;
+	
+	// The batched and compiled machines number their states like the State enum
+	moonMachine = settings.moonMachine;
+	if (moonMachine == BatchedMachine) {
+		DistanceBatchCondition* closer = new DistanceBatchCondition();
+		closer->first.push_back(&moon->Position);
+		closer->second.push_back(&earth->Position);
+		closer->transitionDistance = 1.0f;
+		closer->checkIfCloser = true;
+		
+		DistanceBatchCondition* further = new DistanceBatchCondition(*closer);
+		further->checkIfCloser = false;
+		
+		moonDefinition = new StateMachineDefinition();
+		moonDefinition->addState();
+		moonDefinition->addState();
+		moonDefinition->addTransition(Wandering, Following, closer);
+		moonDefinition->addTransition(Following, Wandering, further);
+		moonDefinition->initialState = Wandering;
+		
+		moonBatch = new StateMachineBatch(moonDefinition);
+		moonBatch->addAgent();
+	}
+	else if (moonMachine == CompiledMachine) {
+		moonCompiled = new CompiledStateMachine();
+		moonCompiled->addState();
+		moonCompiled->addState();
+		unsigned closer = moonCompiled->addDistance(&moon->Position, 0, &earth->Position, 0, 1.0f, true);
+		unsigned further = moonCompiled->addDistance(&moon->Position, 0, &earth->Position, 0, 1.0f, false);
+		const unsigned enterFollowing = Following;
+		const unsigned enterWandering = Wandering;
+		moonCompiled->addTransition(Wandering, closer, Following, &enterFollowing, 1);
+		moonCompiled->addTransition(Following, further, Wandering, &enterWandering, 1);
+		moonCompiled->initialState = Wandering;
+		moonCompiled->compile();
+		moonCompiledState = (unsigned short)moonCompiled->initialState;
+	}
+	
+	
+	// Set up the boids
+	boids.resize(settings.boidCount);
+	for (unsigned i = 0; i < settings.boidCount; i++) {
+		boids[i] = new AICharacter();
+		AICharacter* current = boids[i];
+		current->Position[0] = Wander::randomBinomial(worldSize);
+		current->Position[1] = Wander::randomBinomial(worldSize);
+		current->Orientation = Wander::randomReal(Kore::pi);
+		current->Velocity[0] = Wander::randomBinomial(2.0f);
+		current->Velocity[1] = Wander::randomReal(2.0f);
+		current->Rotation = 0.0f;
+		flock.boids.push_back(current);
+	}
+	
+	// Neighbourhood queries read the boids from contiguous arrays.
+	// These hold the previous state while the boids are updated in parallel
+	flock.storage = Flock::SoAStorage;
+	
+	aiScheduler = new JobScheduler(settings.threadCount);
+	aiScheduler->deterministic = settings.deterministic;
+	workerScratch.resize(aiScheduler->getWorkerCount());
+	
+	float accel = 2.0f;
+	// Set up the steering behaviours (we use one for all)
+	separation = new Separation;
+	separation->maxAcceleration = accel;
+	separation->neighbourhoodSize = 1.0f;
+	separation->neighbourhoodMinDP = -1.0f;
+	separation->theFlock = &flock;
+	
+	cohesion = new Cohesion;
+	cohesion->maxAcceleration = accel;
+	cohesion->neighbourhoodSize = 1.0f;
+	cohesion->neighbourhoodMinDP = 0.0f;
+	cohesion->theFlock = &flock;
+	
+	vMA = new VelocityMatchAndAlign;
+	vMA->maxAcceleration = accel;
+	vMA->neighbourhoodSize = 2.0f;
+	vMA->neighbourhoodMinDP = 0.0f;
+	vMA->theFlock = &flock;
+	
+	flockSteering = new FlockingSteering();
+	flockSteering->theFlock = &flock;
+	flockSteering->separation = separation;
+	flockSteering->separationWeight = 0.1f;
+	flockSteering->cohesion = cohesion;
+	flockSteering->cohesionWeight = 1.0f;
+	flockSteering->velocityMatch = vMA;
+	flockSteering->velocityMatchWeight = 2.0f;
+}
+
+void Simulation::update(float deltaT) {
+	PROFILE_ZONE("updateAI");
+	tickDuration = deltaT;
+	
+	// The moon and the earth: state machine -> steering -> integrate.
+	// The earth goes last because the moon's condition and its seek behaviour read the earth's position
+	Job* stateMachineJob = aiScheduler->createJob(updateMoonStateMachine, nullptr);
+	Job* moonSteeringJob = aiScheduler->createJob(updateMoonSteering, nullptr);
+	Job* moonJob = aiScheduler->createJob(integrateMoon, nullptr);
+	Job* earthJob = aiScheduler->createJob(integrateEarth, nullptr);
+	aiScheduler->addDependency(stateMachineJob, moonSteeringJob);
+	aiScheduler->addDependency(moonSteeringJob, moonJob);
+	aiScheduler->addDependency(moonJob, earthJob);
+	
+	// The boids, independent of the moon and the earth: snapshot -> steer and integrate in parallel
+	Job* snapshotJob = aiScheduler->createJob(snapshotFlock, nullptr);
+	Job* boidsJob = aiScheduler->createParallelFor((unsigned)boids.size(), boidBatchSize, updateBoids, &tickDuration);
+	aiScheduler->addDependency(snapshotJob, boidsJob);
+	
+	aiScheduler->submit(stateMachineJob);
+	aiScheduler->submit(moonSteeringJob);
+	aiScheduler->submit(moonJob);
+	aiScheduler->submit(earthJob);
+	aiScheduler->submit(snapshotJob);
+	aiScheduler->submit(boidsJob);
+	
+	// Tick barrier, the calling thread helps until the tick is done
+	aiScheduler->waitAll();
+}
+
+void Simulation::setPlayerInput(const vec2& delta) {
+	deltaPosition = delta;
+}
+
+AICharacter* Simulation::getMoon() {
+	return moon;
+}
+
+AICharacter* Simulation::getEarth() {
+	return earth;
+}
+
+unsigned Simulation::getBoidCount() {
+	return (unsigned)boids.size();
+}
+
+AICharacter* Simulation::getBoid(unsigned index) {
+	return boids[index];
+}
+
+JobScheduler* Simulation::getScheduler() {
+	return aiScheduler;
+}
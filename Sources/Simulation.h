@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Kore/Math/Vector.h>
+
+#include "Steering.h"
+
+class JobScheduler;
+
+/**
+* The AI of the exercise: the moon with its state machine, the Earth
+* steered by the player and the flock of boids.
+*
+* The simulation does not know about windows, graphics or the clock.
+* It is advanced by update() with the duration of a tick, so it can
+* be run by the game as well as by the headless benchmark.
+*/
+namespace Simulation {
+	// The world is viewed using an orthographic projection and represents toroidal space: Objects that leave on one side come out on the other side.
+	const float worldSize = 3.0f;
+
+	// How the moon's state machine is run, they all behave the same
+	enum MachineKind {
+		// StateMachine with state, transition and condition objects
+		ObjectMachine,
+		// A StateMachineBatch of one agent
+		BatchedMachine,
+		// A CompiledStateMachine of one agent
+		CompiledMachine
+	};
+
+	struct Settings {
+		Settings();
+
+		// The number of boids in the simulation
+		unsigned boidCount;
+
+		// Seed for Kore::Random, runs with the same seed and settings are identical
+		int seed;
+
+		// Number of threads that run the AI including the calling thread, 0 uses all hardware threads
+		unsigned threadCount;
+
+		// Run all AI jobs on the calling thread in a fixed order, e.g. for debugging.
+		// Not needed for reproducible boids, they do not depend on the update order
+		bool deterministic;
+
+		MachineKind moonMachine;
+	};
+
+	// Creates the moon, the Earth and the boids
+	void init(const Settings& settings);
+
+	// Advances the AI by deltaT seconds
+	void update(float deltaT);
+
+	// Steering requested by the player for the Earth, applied in every following update
+	void setPlayerInput(const Kore::vec2& delta);
+
+	AICharacter* getMoon();
+	AICharacter* getEarth();
+	unsigned getBoidCount();
+	AICharacter* getBoid(unsigned index);
+
+	// The scheduler that runs the AI, can be used for other work between updates on the thread that calls update
+	JobScheduler* getScheduler();
+}
@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "SpatialGrid.h"
+
+using namespace Kore;
+
+namespace {
+	// Upper bound for the grid resolution, keeps the cell array small for tiny query radii
+	const int maxCellsPerSide = 1024;
+}
+
+SpatialGrid::SpatialGrid()
+:
+worldSize(1.0f), inverseCellSize(1.0f), cellsPerSide(0)
+{}
+
+void SpatialGrid::reset(float worldSize, float cellSize, unsigned entryCount)
+{
+	this->worldSize = worldSize;
+
+	// Fit a whole number of cells of at least cellSize into the world
+	int cells = cellSize > 0.0f ? (int)(2.0f * worldSize / cellSize) : 1;
+	if (cells < 1) cells = 1;
+	if (cells > maxCellsPerSide) cells = maxCellsPerSide;
+	cellsPerSide = cells;
+	inverseCellSize = (float)cells / (2.0f * worldSize);
+
+	cellHead.assign(cells * cells, -1);
+	nextEntry.assign(entryCount, -1);
+	previousEntry.assign(entryCount, -1);
+	entryCell.assign(entryCount, -1);
+}
+
+int SpatialGrid::cellCoordinate(float value) const
+{
+	float cell = (value + worldSize) * inverseCellSize;
+	if (cell < 0.0f) return 0;
+	if (cell >= (float)cellsPerSide) return cellsPerSide - 1;
+	return (int)cell;
+}
+
+int SpatialGrid::cellIndex(const vec2& position) const
+{
+	return cellCoordinate(position.y()) * cellsPerSide + cellCoordinate(position.x());
+}
+
+void SpatialGrid::link(unsigned entry, int cell)
+{
+	int head = cellHead[cell];
+	previousEntry[entry] = -1;
+	nextEntry[entry] = head;
+	if (head >= 0) previousEntry[head] = entry;
+	cellHead[cell] = entry;
+	entryCell[entry] = cell;
+}
+
+void SpatialGrid::unlink(unsigned entry)
+{
+	int previous = previousEntry[entry];
+	int next = nextEntry[entry];
+	if (previous >= 0) nextEntry[previous] = next;
+	else cellHead[entryCell[entry]] = next;
+	if (next >= 0) previousEntry[next] = previous;
+	entryCell[entry] = -1;
+}
+
+void SpatialGrid::insert(unsigned entry, const vec2& position)
+{
+	link(entry, cellIndex(position));
+}
+
+void SpatialGrid::move(unsigned entry, const vec2& position)
+{
+	int cell = cellIndex(position);
+	if (cell == entryCell[entry]) return;
+	unlink(entry);
+	link(entry, cell);
+}
+
+void SpatialGrid::query(const vec2& center, float radius, std::vector<unsigned>& result) const
+{
+	int minX = cellCoordinate(center.x() - radius);
+	int maxX = cellCoordinate(center.x() + radius);
+	int minY = cellCoordinate(center.y() - radius);
+	int maxY = cellCoordinate(center.y() + radius);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		for (int x = minX; x <= maxX; ++x)
+		{
+			for (int entry = cellHead[y * cellsPerSide + x]; entry >= 0; entry = nextEntry[entry])
+			{
+				result.push_back((unsigned)entry);
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Kore/Math/Vector.h>
+
+#include <vector>
+
+/**
+* A uniform grid laid over the square world [-worldSize, worldSize]
+* that is used to find the members of a flock close to a point
+* without testing every member.
+*
+* Entries are identified by their index (e.g. their position in the
+* flock) and are kept in a doubly linked list per cell, so that an
+* entry can be moved in constant time when its owner moves.
+*
+* Positions outside of the world are put into the closest border
+* cell. This keeps the mapping from coordinates to cells monotonic,
+* so a query always sees every entry that lies within its radius.
+*/
+class SpatialGrid
+{
+public:
+	SpatialGrid();
+
+	/**
+	* Removes all entries and sets up square cells that are at least
+	* cellSize wide for up to entryCount entries.
+	*/
+	void reset(float worldSize, float cellSize, unsigned entryCount);
+
+	/**
+	* Puts the entry into the cell that contains the position.
+	*/
+	void insert(unsigned entry, const Kore::vec2& position);
+
+	/**
+	* Moves an entry that has already been inserted to the cell that
+	* contains its new position.
+	*/
+	void move(unsigned entry, const Kore::vec2& position);
+
+	/**
+	* Appends every entry stored in a cell that overlaps the square
+	* of half-width radius around center to the result. The result
+	* is a superset of the entries within the radius and is not
+	* sorted.
+	*/
+	void query(const Kore::vec2& center, float radius, std::vector<unsigned>& result) const;
+
+	int getCellsPerSide() const
+	{
+		return cellsPerSide;
+	}
+
+private:
+	int cellCoordinate(float value) const;
+	int cellIndex(const Kore::vec2& position) const;
+	void link(unsigned entry, int cell);
+	void unlink(unsigned entry);
+
+	float worldSize;
+	float inverseCellSize;
+	int cellsPerSide;
+
+	// First entry of each cell, -1 if the cell is empty
+	std::vector<int> cellHead;
+
+	// Per entry links and the cell the entry is currently stored in
+	std::vector<int> nextEntry;
+	std::vector<int> previousEntry;
+	std::vector<int> entryCell;
+};
@@ -1,6 +1,17 @@
 #include "pch.h"
 #include "StateMachine.h"
 
+namespace {
+	// Appends a list of actions to the list that runs from first to last. Any of the lists may be empty
+	void appendActions(Action*& first, Action*& last, Action* list)
+	{
+		if (list == nullptr) return;
+		if (first == nullptr) first = list;
+		else last->next = list;
+		last = list->getLast();
+	}
+}
+
 StateMachineState * FixedTargetTransitionMixin::getTargetState()
 {
 	return target;
@@ -68,23 +79,13 @@ Action* StateMachine::update()
 			StateMachineState * nextState = transition->getTargetState();
 
 			// Accumulate our list of actions
-			Action * tempList = nullptr;
 			Action * last = nullptr;
 
 			// Add each element to the list in turn
-			actions = currentState->getExitActions();
-			last = actions->getLast();
-
-			tempList = transition->getActions();
-			last->next = tempList;
-			last = tempList->getLast();
-
-			tempList = nextState->getEntryActions();
-			last->next = tempList;
-			last = tempList->getLast();
-
-			tempList = nextState->getActions();
-			last->next = tempList;
+			appendActions(actions, last, currentState->getExitActions());
+			appendActions(actions, last, transition->getActions());
+			appendActions(actions, last, nextState->getEntryActions());
+			appendActions(actions, last, nextState->getActions());
 
 			// Update the change of state
 			currentState = nextState;
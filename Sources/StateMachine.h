@@ -42,17 +42,22 @@ public:
 * This represents one internal state a character be in: such as
 * angry, or searching-for-ammo.
 */
-class StateMachineState
+class StateMachineState : public Memory::Tracked<Memory::AIMemory>
 {
 public:
+	/**
+	* States are deleted through this class, so the destructor is
+	* virtual.
+	*/
+	virtual ~StateMachineState() {}
+
 	/**
 	* Returns the first in a sequence of actions that should be
 	* performed while the character is in this state.
 	*
-	* Note that this method should return one or more newly
-	* created action instances, and the caller of this method
-	* should be responsible for the deletion. In the default
-	* implementation, it returns nothing.
+	* Note that the returned actions belong to the frame, see
+	* createFrameAction. In the default implementation, it
+	* returns nothing.
 	*/
 	virtual Action * getActions();
 
@@ -60,10 +65,9 @@ public:
 	* Returns the sequence of actions to perform when arriving in
 	* this state.
 	*
-	* Note that this method should return one or more newly
-	* created action instances, and the caller of this method
-	* should be responsible for the deletion. In the default
-	* implementation, it returns nothing.
+	* Note that the returned actions belong to the frame, see
+	* createFrameAction. In the default implementation, it
+	* returns nothing.
 	*/
 	virtual Action * getEntryActions();
 
@@ -71,10 +75,9 @@ public:
 	* Returns the sequence of actions to perform when leaving
 	* this state.
 	*
-	* Note that this method should return one or more newly
-	* created action instances, and the caller of this method
-	* should be responsible for the deletion. In the default
-	* implementation, it returns nothing.
+	* Note that the returned actions belong to the frame, see
+	* createFrameAction. In the default implementation, it
+	* returns nothing.
 	*/
 	virtual Action * getExitActions();
 
@@ -106,6 +109,8 @@ public:
 	/**
 	* This method runs the state machine - it checks for
 	* transitions, applies them and returns a list of actions.
+	* The actions are owned by the frame (see createFrameAction).
+	* Without a transition nothing is allocated.
 	*/
 	virtual Action * update();
 };
\ No newline at end of file
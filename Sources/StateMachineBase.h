@@ -20,6 +20,10 @@
 * are then extended and used by other types of state machines.
 */
 
+#include "Memory.h"
+
+#include <new>
+
 
 /**
 * The action class is the base class for any request the AI makes
@@ -59,6 +63,23 @@ public:
 	virtual void act() {};
 };
 
+/**
+* Creates an action in frame memory (see Memory::allocateFrame).
+*
+* This is how the state machines in this project hand out actions:
+* the frame owns them, so they must not be deleted and are only
+* valid until the next Memory::resetFrame. Creating one costs a
+* pointer bump instead of a heap allocation. Actions created like
+* this never have their destructor called, so they should not own
+* resources.
+*/
+template<class T> T* createFrameAction()
+{
+	T* action = new (Memory::allocateFrame<T>(1, Memory::ActionMemory)) T();
+	action->next = nullptr;
+	return action;
+}
+
 
 
 
@@ -68,9 +89,15 @@ public:
 	* transitions, but does give values for the actions to be carried
 	* out and the triggering.
 	*/
-	class BaseTransition
+	class BaseTransition : public Memory::Tracked<Memory::AIMemory>
 	{
 	public:
+		/**
+		* Transitions are deleted through this class, so the
+		* destructor is virtual.
+		*/
+		virtual ~BaseTransition() {}
+
 		/**
 		* The transition needs to decide if it can be triggered or
 		* not. This will depend on the sub-class of transition we're
@@ -82,10 +109,9 @@ public:
 		* The transition can also optionally return a list of actions
 		* that need to be performed during the transition.
 		*
-		* Note that this method should return one or more newly
-		* created action instances, and the caller of this method
-		* should be responsible for the deletion. In the default
-		* implementation, it returns nothing.
+		* Note that the returned actions belong to the frame, see
+		* createFrameAction. In the default implementation, it
+		* returns nothing.
 		*/
 		virtual Action * getActions();
 
@@ -110,9 +136,15 @@ public:
 	* transitions should fire by having a separate set of condition
 	* instances that can be combined together with boolean operators.
 	*/
-	class Condition
+	class Condition : public Memory::Tracked<Memory::AIMemory>
 	{
 	public:
+		/**
+		* Conditions are deleted through this class, so the
+		* destructor is virtual.
+		*/
+		virtual ~Condition() {}
+
 		/**
 		* Performs the test for this condition.
 		*/
@@ -3,6 +3,7 @@
 #include <Kore/Math/Vector.h>
 #include <Kore/Math/Random.h>
 #include "MeshObject.h"
+#include "Memory.h"
 
 
 #include <vector>
@@ -40,7 +41,7 @@ struct SteeringOutput
 
 
 
-class AICharacter {
+class AICharacter : public Memory::Tracked<Memory::AIMemory> {
 public:
 	Kore::vec2 Position;
 
@@ -113,9 +114,15 @@ public:
 * The steering behaviour is the base class for all dynamic
 * steering behaviours.
 */
-class SteeringBehaviour
+class SteeringBehaviour : public Memory::Tracked<Memory::AIMemory>
 {
 public:
+	/**
+	* Behaviours are deleted through this class, so the memory
+	* tracking sees the size of the actual behaviour.
+	*/
+	virtual ~SteeringBehaviour() {}
+
 	/**
 	* The character who is moving.
 	*/
@@ -4,6 +4,22 @@ project.addFile('Sources/**');
 project.setDebugDir('Deployment');
 project.cpp11 = true;
 
+// Set EXERCISE_HEADLESS to build the AI benchmark without a window
+if (process.env.EXERCISE_HEADLESS) {
+	project.addDefine('EXERCISE_HEADLESS');
+}
+
+// Set EXERCISE_MESH_CONVERTER to build the tool that converts .obj files into binary meshes
+// (Deployment/Makefile builds it and converts the level meshes on its own)
+if (process.env.EXERCISE_MESH_CONVERTER) {
+	project.addDefine('EXERCISE_MESH_CONVERTER');
+}
+
+// Set EXERCISE_BENCHMARK to build the microbenchmarks of the AI and the OBJ loader
+if (process.env.EXERCISE_BENCHMARK) {
+	project.addDefine('EXERCISE_BENCHMARK');
+}
+
 Project.createProject('Kore', __dirname).then((subproject) => {
 	project.addSubProject(subproject);
 	resolve(project);